@@ -12,6 +12,7 @@
 #include <boost/config.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/utility/string_ref.hpp>
 #endif
 
 #if HAVE_VECTOR
@@ -22,6 +23,46 @@
 #   include <memory>
 #endif
 
+#if HAVE_MEMORY_RESOURCE
+#   include <memory_resource>
+#endif
+
+#if HAVE_ALGORITHM
+#   include <algorithm>
+#endif
+
+#if HAVE_UNORDERED_MAP
+#   include <unordered_map>
+#endif
+
+#if HAVE_THREAD
+#   include <thread>
+#endif
+
+#if HAVE_MUTEX
+#   include <mutex>
+#endif
+
+#if HAVE_ATOMIC
+#   include <atomic>
+#endif
+
+#if HAVE_CHRONO
+#   include <chrono>
+#endif
+
+#if HAVE_LIMITS
+#   include <limits>
+#endif
+
+#if HAVE_MAP
+#   include <map>
+#endif
+
+#if HAVE_DEQUE
+#   include <deque>
+#endif
+
 #if HAVE_STRING
 #   include <string>
 #endif
@@ -56,10 +97,34 @@
 #   include <sys/types.h>
 #endif
 
+#if HAVE_STDINT_H
+#   include <stdint.h>
+#endif
+
+#if HAVE_STDIO_H
+#   include <stdio.h>
+#endif
+
+#if HAVE_STRING_H
+#   include <string.h>
+#endif
+
+#if HAVE_ERRNO_H
+#   include <errno.h>
+#endif
+
 #if HAVE_SIGNAL_H
 #   include <signal.h>
 #endif
 
+#if HAVE_EMMINTRIN_H
+#   include <emmintrin.h>
+#endif
+
+#if HAVE_IMMINTRIN_H
+#   include <immintrin.h>
+#endif
+
 #if HAVE_PWD_H
 #   include <pwd.h>
 #endif
@@ -143,6 +208,58 @@ extern "C"
 #   include <unistd.h>
 #endif
 
+#if HAVE_FCNTL_H
+#   include <fcntl.h>
+#endif
+
+#if HAVE_DIRENT_H
+#   include <dirent.h>
+#endif
+
+#if HAVE_SYS_SYSCALL_H
+#   include <sys/syscall.h>
+#endif
+
+#if HAVE_SYS_MMAN_H
+#   include <sys/mman.h>
+#endif
+
+#if HAVE_SYS_STAT_H
+#   include <sys/stat.h>
+#endif
+
+#if HAVE_LINUX_IO_URING_H
+#   include <linux/io_uring.h>
+#endif
+
+#if HAVE_TIME_H
+#   include <time.h>
+#endif
+
+#if HAVE_POLL_H
+#   include <poll.h>
+#endif
+
+#if HAVE_SYS_EPOLL_H
+#   include <sys/epoll.h>
+#endif
+
+#if HAVE_SYS_SOCKET_H
+#   include <sys/socket.h>
+#endif
+
+#if HAVE_LINUX_NETLINK_H
+#   include <linux/netlink.h>
+#endif
+
+#if HAVE_LINUX_CONNECTOR_H
+#   include <linux/connector.h>
+#endif
+
+#if HAVE_LINUX_CN_PROC_H
+#   include <linux/cn_proc.h>
+#endif
+
 #if HAVE_SYS_SYSCTL_H
 #   include <sys/sysctl.h>
 #endif
@@ -234,6 +351,32 @@ BOOL CALLBACK find_pid_from_window( HWND window_handle, LPARAM param )
 }
 #endif
 
+// closes a posix file descriptor when going out of scope
+struct file_descriptor : public boost::noncopyable
+{
+    explicit
+    file_descriptor( const int fd = -1 )
+        : m_fd( fd )
+    {
+    }
+
+    ~file_descriptor()
+    {
+#if HAVE_UNISTD_H
+        if ( m_fd >= 0 )
+            close( m_fd );
+#endif
+    }
+
+    int get() const
+    {
+        return m_fd;
+    }
+
+private:
+    int m_fd;
+};
+
 #if defined( _WIN32 ) || defined( _WIN64 )
 struct handle : public boost::noncopyable
 {
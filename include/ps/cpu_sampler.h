@@ -0,0 +1,285 @@
+#ifndef PS_CPU_SAMPLER_H
+#define PS_CPU_SAMPLER_H
+
+#include "config.h"
+#include "ps/common.h"
+#include "ps/procfs.h"
+#include "ps/sampling.h"
+
+#if PS_HAVE_PROCFS
+#   define PS_HAVE_CPU_SAMPLER 1
+#else
+#   define PS_HAVE_CPU_SAMPLER 0
+#endif
+
+namespace ps
+{
+
+/**@struct cpu_usage
+ * @brief How much CPU a process used between two ticks of a cpu_sampler
+ *
+ * Percentages are those of one CPU, as top shows them: a process keeping two
+ * cores busy uses 200%. */
+struct cpu_usage
+{
+    pid_t              pid;
+    unsigned long long start_time; ///< with the pid, tells the process apart from a later one reusing the pid
+    double             total;      ///< user + system
+    double             user;       ///< the percentage spent in user mode
+    double             system;     ///< the percentage spent in kernel mode
+};
+
+/**@struct system_cpu_usage
+ * @brief How much of the machine was busy between two ticks of a cpu_sampler
+ *
+ * Percentages are those of all the CPUs together: 100% means every core was
+ * busy. */
+struct system_cpu_usage
+{
+    system_cpu_usage()
+        : total( 0 )
+        , user( 0 )
+        , system( 0 )
+        , iowait( 0 )
+        , idle( 0 )
+        , cpus( 0 )
+    {
+    }
+
+    double   total;  ///< the percentage of time the CPUs were not idle
+    double   user;   ///< the percentage spent in user mode, niced processes included
+    double   system; ///< the percentage spent in kernel mode, interrupts included
+    double   iowait; ///< the percentage spent idle, waiting for I/O
+    double   idle;   ///< the percentage spent idle, not waiting for I/O
+    unsigned cpus;   ///< the number of CPUs online
+};
+
+namespace details
+{
+
+// the first line of /proc/stat, in clock ticks summed over every CPU
+struct cpu_times
+{
+    unsigned long long user;
+    unsigned long long nice;
+    unsigned long long system;
+    unsigned long long idle;
+    unsigned long long iowait;
+    unsigned long long irq;
+    unsigned long long softirq;
+    unsigned long long steal;
+
+    unsigned long long total() const
+    {
+        return user + nice + system + idle + iowait + irq + softirq + steal;
+    }
+};
+
+// parses "cpu  user nice system idle iowait irq softirq steal ...". Fields
+// missing from old kernels are left at 0
+static inline
+bool parse_cpu_times( const char * const data, const std::size_t length, cpu_times & times )
+{
+    const char * const end = data + length;
+    if ( length < 4 || memcmp( data, "cpu ", 4 ) != 0 )
+        return false;
+
+    unsigned long long * const fields[] = { &times.user, &times.nice, &times.system, &times.idle,
+                                            &times.iowait, &times.irq, &times.softirq, &times.steal };
+
+    const char * position = data + 4;
+    std::size_t parsed = 0;
+    for ( ; parsed < sizeof( fields ) / sizeof( fields[0] ); ++parsed )
+    {
+        while ( position != end && *position == ' ' )
+            ++position;
+
+        if ( position == end || *position < '0' || *position > '9' )
+            break;
+
+        unsigned long long value = 0;
+        for ( ; position != end && *position >= '0' && *position <= '9'; ++position )
+            value = value * 10 + ( *position - '0' );
+
+        *fields[parsed] = value;
+    }
+
+    for ( std::size_t i = parsed; i < sizeof( fields ) / sizeof( fields[0] ); ++i )
+        *fields[i] = 0;
+
+    // user, nice, system and idle are there since linux 2.6
+    return parsed >= 4;
+}
+
+static inline
+bool read_cpu_times( cpu_times & times )
+{
+#if PS_HAVE_PROCFS
+    const file_descriptor file( openat( procfs_dirfd(), "stat", O_RDONLY | O_CLOEXEC ) );
+    if ( file.get() == -1 )
+        return false;
+
+    // the first line is all we need, and it fits in the scratch buffer
+    char * const scratch = procfs_scratch_buffer();
+    ssize_t length;
+    do
+    {
+        length = ::read( file.get(), scratch, PROCFS_SCRATCH_SIZE );
+    }
+    while ( length < 0 && errno == EINTR );
+
+    return length > 0 && parse_cpu_times( scratch, static_cast< std::size_t >( length ), times );
+#else
+    ( void )times;
+    return false;
+#endif
+}
+
+} // ns details
+
+#if PS_HAVE_CPU_SAMPLER
+/**@struct cpu_sampler
+ * @brief Computes the CPU usage of every process from one tick to the next
+ *
+ * Each tick reads /proc/stat and the stat file of every running process,
+ * and compares their times with those of the previous tick. Processes are
+ * identified by their pid and start time, so that a pid reused between two
+ * ticks is not mistaken for the process which had it before: a process which
+ * started since the previous tick is charged with all its time. The first
+ * tick has nothing to compare with, so every process uses 0%.
+ *
+ * The samples are kept in vectors sorted by pid and merged from one tick to
+ * the next, so the cost is linear in the number of processes, and ticks do
+ * not allocate once the vectors are large enough for every process. */
+struct cpu_sampler : boost::noncopyable
+{
+    cpu_sampler()
+        : m_cpus( 1 )
+        , m_ticks_per_second( details::clock_ticks_per_second() )
+        , m_uptime( 0 )
+        , m_ticks( 0 )
+    {
+        memset( &m_times, 0, sizeof( m_times ) );
+#if HAVE_UNISTD_H
+        const long online = sysconf( _SC_NPROCESSORS_ONLN );
+        m_cpus = online > 0 ? static_cast< unsigned >( online ) : 1;
+#endif
+    }
+
+    /**@brief Samples the running processes
+     * @return The usage of every process since the previous tick, sorted by
+     *         pid. The vector is overwritten by the next tick */
+    const std::vector< cpu_usage > & tick()
+    {
+        details::cpu_times times;
+        if ( !details::read_cpu_times( times ) )
+            times = m_times;
+
+        // without /proc/uptime, the busy and idle time of one CPU come close to it
+        unsigned long long uptime;
+        if ( !details::read_uptime( m_ticks_per_second, uptime ) )
+            uptime = times.total() / m_cpus;
+
+        m_pids.clear();
+        details::thread_procfs_directory().read_pids( m_pids );
+        std::sort( m_pids.begin(), m_pids.end() );
+
+        m_current.clear();
+        for ( const pid_t pid : m_pids )
+        {
+            process_stat stat;
+            if ( !details::read_process_stat( pid, stat ) )
+                continue;
+
+            const sample s = { pid, stat.start_time, { stat.utime, stat.stime } };
+            m_current.push_back( s );
+        }
+
+        // the time elapsed, in clock ticks of one CPU
+        const unsigned long long elapsed_total = details::counter_delta( times.total(), m_times.total() );
+        const double elapsed = static_cast< double >( elapsed_total ) / m_cpus;
+        const double to_percent = ( m_ticks > 0 && elapsed > 0 ) ? 100.0 / elapsed : 0.0;
+
+        m_usage.clear();
+        details::match_samples( m_current, m_previous, m_uptime,
+                                [&]( const sample & s, const cpu_time & baseline )
+        {
+            cpu_usage usage;
+            usage.pid        = s.pid;
+            usage.start_time = s.start_time;
+            usage.user       = details::counter_delta( s.counters.user, baseline.user ) * to_percent;
+            usage.system     = details::counter_delta( s.counters.system, baseline.system ) * to_percent;
+            usage.total      = usage.user + usage.system;
+            m_usage.push_back( usage );
+        } );
+
+        update_system_usage( times, elapsed_total );
+
+        m_previous.swap( m_current );
+        m_times = times;
+        m_uptime = uptime;
+        ++m_ticks;
+        return m_usage;
+    }
+
+    /**@brief Returns the usage of the whole machine between the last two ticks */
+    const system_cpu_usage & system_usage() const
+    {
+        return m_system;
+    }
+
+    /**@brief Returns the usage computed by the last tick, sorted by pid */
+    const std::vector< cpu_usage > & usage() const
+    {
+        return m_usage;
+    }
+
+    /**@brief Returns the number of ticks so far */
+    unsigned long long ticks() const
+    {
+        return m_ticks;
+    }
+
+private:
+    // the clock ticks a process spent in user and kernel mode
+    struct cpu_time
+    {
+        unsigned long long user;
+        unsigned long long system;
+    };
+
+    typedef details::process_sample< cpu_time > sample;
+
+    void update_system_usage( const details::cpu_times & times, const unsigned long long elapsed )
+    {
+        m_system = system_cpu_usage();
+        m_system.cpus = m_cpus;
+        if ( m_ticks == 0 || elapsed == 0 )
+            return;
+
+        using details::counter_delta;
+        const double to_percent = 100.0 / elapsed;
+        m_system.user   = counter_delta( times.user + times.nice, m_times.user + m_times.nice ) * to_percent;
+        m_system.system = counter_delta( times.system + times.irq + times.softirq,
+                                         m_times.system + m_times.irq + m_times.softirq ) * to_percent;
+        m_system.iowait = counter_delta( times.iowait, m_times.iowait ) * to_percent;
+        m_system.idle   = counter_delta( times.idle, m_times.idle ) * to_percent;
+        m_system.total  = std::max( 0.0, 100.0 - m_system.idle - m_system.iowait );
+    }
+
+    unsigned                 m_cpus;
+    unsigned long long       m_ticks_per_second;
+    unsigned long long       m_uptime;
+    unsigned long long       m_ticks;
+    details::cpu_times       m_times;
+    system_cpu_usage         m_system;
+    std::vector< pid_t >     m_pids;
+    std::vector< sample >    m_previous;
+    std::vector< sample >    m_current;
+    std::vector< cpu_usage > m_usage;
+};
+#endif
+
+} // namespace ps
+
+#endif // PS_CPU_SAMPLER_H
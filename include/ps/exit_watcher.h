@@ -0,0 +1,126 @@
+#ifndef PS_EXIT_WATCHER_H
+#define PS_EXIT_WATCHER_H
+
+#include "config.h"
+#include "ps/common.h"
+#include "ps/process.h"
+
+#if PS_HAVE_PIDFD && HAVE_SYS_EPOLL_H && HAVE_CHRONO && HAVE_UNORDERED_MAP
+#   define PS_HAVE_EXIT_WATCHER 1
+#else
+#   define PS_HAVE_EXIT_WATCHER 0
+#endif
+
+namespace ps
+{
+
+#if PS_HAVE_EXIT_WATCHER
+/**@struct exit_watcher
+ * @brief Waits for any of many processes to exit
+ *
+ * The pidfds of every watched process are registered on a single epoll
+ * instance, so that thousands of processes can be supervised by one thread,
+ * without polling. */
+struct exit_watcher : boost::noncopyable
+{
+    exit_watcher()
+        : m_epoll( epoll_create1( EPOLL_CLOEXEC ) )
+    {
+    }
+
+    ~exit_watcher()
+    {
+        if ( m_epoll != -1 )
+            close( m_epoll );
+    }
+
+    bool is_open() const
+    {
+        return m_epoll != -1;
+    }
+
+    /**@brief Returns the number of processes being watched */
+    std::size_t size() const
+    {
+        return m_watched.size();
+    }
+
+    /**@brief Starts watching a process
+     *
+     * The pidfd of the process is used if it has one, otherwise one is opened.
+     * @return false if the process is gone, or if pidfds are not supported */
+    bool watch( const process & watched )
+    {
+        if ( !is_open() || m_watched.count( watched.pid() ) )
+            return false;
+
+        process pinned( watched );
+        if ( !pinned.open_pidfd() )
+            return false;
+
+        epoll_event event;
+        memset( &event, 0, sizeof( event ) );
+        event.events = EPOLLIN;
+        event.data.u64 = static_cast< uint64_t >( pinned.pid() );
+
+        if ( epoll_ctl( m_epoll, EPOLL_CTL_ADD, pinned.pidfd(), &event ) != 0 )
+            return false;
+
+        m_watched.insert( std::make_pair( pinned.pid(), PS_MOVE( pinned ) ) );
+        return true;
+    }
+
+    /**@brief Stops watching a process
+     * @return false if the process was not watched */
+    bool unwatch( const pid_t pid )
+    {
+        const auto watched = m_watched.find( pid );
+        if ( watched == m_watched.end() )
+            return false;
+
+        epoll_ctl( m_epoll, EPOLL_CTL_DEL, watched->second.pidfd(), nullptr );
+        m_watched.erase( watched );
+        return true;
+    }
+
+    /**@brief Waits until at least one watched process exits
+     *
+     * The processes which exited are not watched anymore.
+     * @param[in] timeout How long to wait. A negative value waits forever
+     * @return The pids of the processes which exited, empty if the timeout expired */
+    std::vector< pid_t > wait_exit( const std::chrono::milliseconds timeout )
+    {
+        std::vector< pid_t > exited;
+        if ( m_watched.empty() )
+            return exited;
+
+        m_events.resize( std::min< std::size_t >( m_watched.size(), 1024 ) );
+
+        int ready;
+        do
+        {
+            ready = epoll_wait( m_epoll, m_events.data(), static_cast< int >( m_events.size() ),
+                                timeout.count() < 0 ? -1 : static_cast< int >( timeout.count() ) );
+        }
+        while ( ready < 0 && errno == EINTR );
+
+        for ( int i = 0; i < ready; ++i )
+        {
+            const pid_t pid = static_cast< pid_t >( m_events[i].data.u64 );
+            if ( unwatch( pid ) )
+                exited.push_back( pid );
+        }
+
+        return exited;
+    }
+
+private:
+    int                                   m_epoll;
+    std::unordered_map< pid_t, process >  m_watched;
+    std::vector< epoll_event >            m_events;
+};
+#endif
+
+} // namespace ps
+
+#endif // PS_EXIT_WATCHER_H
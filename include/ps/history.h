@@ -0,0 +1,441 @@
+#ifndef PS_HISTORY_H
+#define PS_HISTORY_H
+
+#include "config.h"
+#include "ps/common.h"
+#include "ps/process.h"
+#include "ps/snapshot.h"
+
+#if HAVE_CHRONO && HAVE_UNORDERED_MAP && HAVE_DEQUE
+#   define PS_HAVE_HISTORY 1
+#else
+#   define PS_HAVE_HISTORY 0
+#endif
+
+namespace ps
+{
+namespace details
+{
+
+static inline
+void write_varint( std::vector< uint8_t > & buffer, uint64_t value )
+{
+    while ( value >= 0x80 )
+    {
+        buffer.push_back( static_cast< uint8_t >( value | 0x80 ) );
+        value >>= 7;
+    }
+
+    buffer.push_back( static_cast< uint8_t >( value ) );
+}
+
+static inline
+uint64_t read_varint( const uint8_t * & position )
+{
+    uint64_t value = 0;
+    for ( unsigned shift = 0; ; shift += 7 )
+    {
+        const uint8_t byte = *position++;
+        value |= static_cast< uint64_t >( byte & 0x7f ) << shift;
+        if ( !( byte & 0x80 ) )
+            return value;
+    }
+}
+
+static inline
+bool same_attributes( const process & left, const process & right )
+{
+    return left.start_time() == right.start_time()
+        && left.cmdline()    == right.cmdline()
+        && left.name()       == right.name()
+        && left.title()      == right.title()
+        && left.version()    == right.version();
+}
+
+} // ns details
+
+#if PS_HAVE_HISTORY
+/**@struct history
+ * @brief Remembers the snapshots of the last ticks in little memory
+ *
+ * The ticks are grouped in segments. Each segment starts with a keyframe,
+ * which holds a whole snapshot, followed by the deltas of the next ticks: the
+ * pids which exited, and the processes which were added or changed. Pids are
+ * delta-encoded as varints, and strings are references into a dictionary of
+ * the segment, so a process which keeps running costs nothing after the
+ * keyframe.
+ *
+ * Memory is bounded: once more than capacity ticks are held, the oldest
+ * segment is dropped as a whole. Seeking a tick is a binary search over the
+ * segments, then the replay of at most keyframe_interval deltas.
+ *
+ * Processes are restored with their pid, start time, command line, title,
+ * name and version. */
+struct history
+{
+    typedef std::chrono::system_clock clock;
+
+    /**@brief Returned by find() when no tick matches */
+    static PS_CONSTEXPR std::size_t npos = static_cast< std::size_t >( -1 );
+
+    /**@param[in] capacity The number of ticks to remember, at least
+     * @param[in] keyframe_interval The number of ticks between two keyframes */
+    explicit
+    history( const std::size_t capacity, const std::size_t keyframe_interval = 60 )
+        : m_capacity( std::max< std::size_t >( 1, capacity ) )
+        , m_keyframe_interval( std::max< std::size_t >( 1, keyframe_interval ) )
+        , m_pushed( 0 )
+    {
+    }
+
+    /**@brief Records the processes running at a given time
+     * @param[in] processes The running processes, in any order
+     * @param[in] when The time of the capture, which must not precede the previous one */
+    void push( const snapshot & processes, const clock::time_point when = clock::now() )
+    {
+        snapshot current( processes );
+        std::sort( current.begin(), current.end(),
+                   []( const process & left, const process & right )
+        {
+            return left.pid() < right.pid();
+        } );
+
+        if ( m_segments.empty() || m_segments.back().ticks() >= m_keyframe_interval )
+        {
+            // the dictionary of the sealed segment is only needed for reading now
+            if ( !m_segments.empty() )
+                m_segments.back().seal();
+
+            m_segments.push_back( segment( m_pushed ) );
+            m_segments.back().add_keyframe( current, when );
+        }
+        else
+        {
+            m_segments.back().add_delta( m_last, current, when );
+        }
+
+        m_last.swap( current );
+        ++m_pushed;
+
+        // the oldest segment goes once the others are enough to fill the window
+        while ( m_segments.size() > 1 && m_pushed - m_segments[1].first_tick() >= m_capacity )
+            m_segments.pop_front();
+    }
+
+    /**@brief Returns the number of ticks remembered */
+    std::size_t size() const
+    {
+        return m_segments.empty() ? 0 : m_pushed - m_segments.front().first_tick();
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    /**@brief Returns the time of a tick. Tick 0 is the oldest one */
+    clock::time_point time( const std::size_t tick ) const
+    {
+        assert( tick < size() );
+        const std::size_t absolute = absolute_tick( tick );
+        const segment & owner = find_segment( absolute );
+        return owner.time( absolute - owner.first_tick() );
+    }
+
+    /**@brief Returns the snapshot of a tick, sorted by pid. Tick 0 is the oldest one */
+    snapshot at( const std::size_t tick ) const
+    {
+        assert( tick < size() );
+        const std::size_t absolute = absolute_tick( tick );
+        const segment & owner = find_segment( absolute );
+        return owner.restore( absolute - owner.first_tick() );
+    }
+
+    /**@brief Returns the last tick recorded at or before a given time, or npos */
+    std::size_t find( const clock::time_point when ) const
+    {
+        if ( empty() || when < time( 0 ) )
+            return npos;
+
+        // the last segment which starts at or before when
+        const auto owner = std::upper_bound( m_segments.begin(), m_segments.end(), when,
+                                             []( const clock::time_point t, const segment & s )
+        {
+            return t < s.time( 0 );
+        } ) - 1;
+
+        return owner->first_tick() + owner->find( when ) - m_segments.front().first_tick();
+    }
+
+    /**@brief Returns the snapshot which was current at a given time
+     * @param[out] processes The processes running at the last tick at or before when
+     * @return false if when precedes the oldest tick remembered */
+    bool at_time( const clock::time_point when, snapshot & processes ) const
+    {
+        const std::size_t tick = find( when );
+        if ( tick == npos )
+            return false;
+
+        processes = at( tick );
+        return true;
+    }
+
+    /**@brief Returns the number of bytes used by the encoded ticks and their dictionaries */
+    std::size_t memory_usage() const
+    {
+        std::size_t bytes = 0;
+        for ( const segment & s : m_segments )
+            bytes += s.memory_usage();
+
+        return bytes;
+    }
+
+private:
+    struct segment
+    {
+        explicit
+        segment( const std::size_t first_tick )
+            : m_first_tick( first_tick )
+        {
+        }
+
+        std::size_t first_tick() const
+        {
+            return m_first_tick;
+        }
+
+        std::size_t ticks() const
+        {
+            return m_times.size();
+        }
+
+        clock::time_point time( const std::size_t tick ) const
+        {
+            return clock::time_point( clock::duration( m_times[tick] ) );
+        }
+
+        // returns the last tick of this segment at or before when
+        std::size_t find( const clock::time_point when ) const
+        {
+            const auto last = std::upper_bound( m_times.begin(), m_times.end(),
+                                                when.time_since_epoch().count() );
+            return static_cast< std::size_t >( last - m_times.begin() ) - 1;
+        }
+
+        void add_keyframe( const snapshot & current, const clock::time_point when )
+        {
+            m_times.push_back( when.time_since_epoch().count() );
+
+            details::write_varint( m_keyframe, current.size() );
+            pid_t previous = 0;
+            for ( const process & p : current )
+                write_process( m_keyframe, p, previous );
+        }
+
+        void add_delta( const snapshot & last, const snapshot & current,
+                        const clock::time_point when )
+        {
+            m_times.push_back( when.time_since_epoch().count() );
+            m_delta_offsets.push_back( static_cast< uint32_t >( m_deltas.size() ) );
+
+            // both snapshots are sorted by pid, so they are merged in one pass
+            std::vector< pid_t > exited;
+            std::vector< const process * > updated;
+            auto before = last.begin();
+            auto after = current.begin();
+            while ( before != last.end() || after != current.end() )
+            {
+                if ( after == current.end() || ( before != last.end() && before->pid() < after->pid() ) )
+                    exited.push_back( ( before++ )->pid() );
+                else if ( before == last.end() || after->pid() < before->pid() )
+                    updated.push_back( &*after++ );
+                else
+                {
+                    if ( !details::same_attributes( *before, *after ) )
+                        updated.push_back( &*after );
+                    ++before;
+                    ++after;
+                }
+            }
+
+            details::write_varint( m_deltas, exited.size() );
+            pid_t previous = 0;
+            for ( const pid_t pid : exited )
+            {
+                details::write_varint( m_deltas, static_cast< uint64_t >( pid - previous ) );
+                previous = pid;
+            }
+
+            details::write_varint( m_deltas, updated.size() );
+            previous = 0;
+            for ( const process * const p : updated )
+                write_process( m_deltas, *p, previous );
+        }
+
+        // rebuilds the snapshot of a tick of this segment
+        snapshot restore( const std::size_t tick ) const
+        {
+            snapshot processes;
+            const uint8_t * position = m_keyframe.data();
+            const std::size_t count = static_cast< std::size_t >( details::read_varint( position ) );
+            processes.reserve( count );
+
+            pid_t previous = 0;
+            for ( std::size_t i = 0; i < count; ++i )
+                processes.push_back( read_process( position, previous ) );
+
+            for ( std::size_t delta = 0; delta < tick; ++delta )
+                apply_delta( m_deltas.data() + m_delta_offsets[delta], processes );
+
+            return processes;
+        }
+
+        // the dictionary lookup is only needed to encode new ticks
+        void seal()
+        {
+            std::unordered_map< std::string, uint32_t >().swap( m_string_ids );
+            m_keyframe.shrink_to_fit();
+            m_deltas.shrink_to_fit();
+        }
+
+        std::size_t memory_usage() const
+        {
+            std::size_t bytes = m_times.capacity() * sizeof( int64_t )
+                              + m_keyframe.capacity()
+                              + m_deltas.capacity()
+                              + m_delta_offsets.capacity() * sizeof( uint32_t );
+
+            for ( const std::string & s : m_strings )
+                bytes += sizeof( std::string ) + s.capacity();
+
+            return bytes;
+        }
+
+    private:
+        // 0 stands for the empty string, other strings for their index in the dictionary + 1
+        uint64_t string_id( const std::string & value )
+        {
+            if ( value.empty() )
+                return 0;
+
+            const auto found = m_string_ids.find( value );
+            if ( found != m_string_ids.end() )
+                return found->second + 1;
+
+            const uint32_t id = static_cast< uint32_t >( m_strings.size() );
+            m_strings.push_back( value );
+            m_string_ids.insert( std::make_pair( value, id ) );
+            return id + 1;
+        }
+
+        const std::string & string_from_id( const uint64_t id ) const
+        {
+            return id == 0 ? details::empty_string() : m_strings[id - 1];
+        }
+
+        // pids are written as the difference with the previous one, as processes are sorted
+        void write_process( std::vector< uint8_t > & buffer, const process & p, pid_t & previous )
+        {
+            details::write_varint( buffer, static_cast< uint64_t >( p.pid() - previous ) );
+            previous = p.pid();
+
+            details::write_varint( buffer, p.start_time() );
+            details::write_varint( buffer, string_id( p.cmdline() ) );
+            details::write_varint( buffer, string_id( p.title() ) );
+            details::write_varint( buffer, string_id( p.name() ) );
+            details::write_varint( buffer, string_id( p.version() ) );
+        }
+
+        process read_process( const uint8_t * & position, pid_t & previous ) const
+        {
+            const pid_t pid = previous + static_cast< pid_t >( details::read_varint( position ) );
+            previous = pid;
+
+            const unsigned long long start_time = details::read_varint( position );
+            const std::string & cmdline = string_from_id( details::read_varint( position ) );
+            const std::string & title   = string_from_id( details::read_varint( position ) );
+            const std::string & name    = string_from_id( details::read_varint( position ) );
+            const std::string & version = string_from_id( details::read_varint( position ) );
+
+            return process( pid, cmdline, title, name, version, start_time );
+        }
+
+        void apply_delta( const uint8_t * position, snapshot & processes ) const
+        {
+            std::vector< pid_t > exited( static_cast< std::size_t >( details::read_varint( position ) ) );
+            pid_t previous = 0;
+            for ( pid_t & pid : exited )
+            {
+                pid = previous + static_cast< pid_t >( details::read_varint( position ) );
+                previous = pid;
+            }
+
+            // reserve() may leave more room than asked for, so the count is kept
+            const std::size_t updated_count = static_cast< std::size_t >( details::read_varint( position ) );
+            snapshot updated;
+            updated.reserve( updated_count );
+            previous = 0;
+            for ( std::size_t i = 0; i < updated_count; ++i )
+                updated.push_back( read_process( position, previous ) );
+
+            // merge the three sorted sequences into the next snapshot
+            snapshot next;
+            next.reserve( processes.size() + updated.size() );
+            auto gone = exited.begin();
+            auto fresh = updated.begin();
+            for ( process & p : processes )
+            {
+                while ( fresh != updated.end() && fresh->pid() < p.pid() )
+                    next.push_back( PS_MOVE( *fresh++ ) );
+
+                while ( gone != exited.end() && *gone < p.pid() )
+                    ++gone;
+
+                if ( fresh != updated.end() && fresh->pid() == p.pid() )
+                    next.push_back( PS_MOVE( *fresh++ ) );
+                else if ( gone == exited.end() || *gone != p.pid() )
+                    next.push_back( PS_MOVE( p ) );
+            }
+
+            for ( ; fresh != updated.end(); ++fresh )
+                next.push_back( PS_MOVE( *fresh ) );
+
+            processes.swap( next );
+        }
+
+        std::size_t                                 m_first_tick;
+        std::vector< int64_t >                      m_times;
+        std::vector< uint8_t >                      m_keyframe;
+        std::vector< uint8_t >                      m_deltas;
+        std::vector< uint32_t >                     m_delta_offsets;
+        std::vector< std::string >                  m_strings;
+        std::unordered_map< std::string, uint32_t > m_string_ids;
+    };
+
+    std::size_t absolute_tick( const std::size_t tick ) const
+    {
+        return m_segments.front().first_tick() + tick;
+    }
+
+    const segment & find_segment( const std::size_t absolute ) const
+    {
+        const auto owner = std::upper_bound( m_segments.begin(), m_segments.end(), absolute,
+                                             []( const std::size_t t, const segment & s )
+        {
+            return t < s.first_tick();
+        } ) - 1;
+
+        return *owner;
+    }
+
+    std::size_t           m_capacity;
+    std::size_t           m_keyframe_interval;
+    std::size_t           m_pushed;
+    std::deque< segment > m_segments;
+    snapshot              m_last;
+};
+#endif
+
+} // namespace ps
+
+#endif // PS_HISTORY_H
@@ -0,0 +1,186 @@
+#ifndef PS_IO_SAMPLER_H
+#define PS_IO_SAMPLER_H
+
+#include "config.h"
+#include "ps/common.h"
+#include "ps/procfs.h"
+#include "ps/sampling.h"
+
+#if PS_HAVE_PROCFS && HAVE_CHRONO
+#   define PS_HAVE_IO_SAMPLER 1
+#else
+#   define PS_HAVE_IO_SAMPLER 0
+#endif
+
+namespace ps
+{
+
+/**@struct io_rate
+ * @brief How much I/O a process did per second between two ticks of an io_sampler */
+struct io_rate
+{
+    pid_t              pid;
+    unsigned long long start_time; ///< with the pid, tells the process apart from a later one reusing the pid
+    double             read;       ///< the bytes fetched from the storage per second
+    double             write;      ///< the bytes sent to the storage per second, minus those cancelled
+    double             rchar;      ///< the bytes read per second, cache hits included
+    double             wchar;      ///< the bytes written per second
+    double             syscr;      ///< the read syscalls per second
+    double             syscw;      ///< the write syscalls per second
+
+    /**@brief Returns the bytes exchanged with the storage per second */
+    double total() const
+    {
+        return read + write;
+    }
+};
+
+#if PS_HAVE_IO_SAMPLER
+/**@struct io_sampler
+ * @brief Computes the I/O rates of every process from one tick to the next
+ *
+ * Each tick reads /proc/<pid>/io and /proc/<pid>/stat for every running
+ * process, and divides the growth of the counters since the previous tick by
+ * the time elapsed. As for cpu_sampler, processes are identified by their pid
+ * and start time, a process which started since the previous tick is charged
+ * with all its counters, and the first tick gives every process a rate of 0.
+ *
+ * Only the owner of a process, or root, may read its counters. The processes
+ * we may not inspect are left out of the rates and counted by denied(), so
+ * that an unprivileged sampler still ranks the processes of its user. */
+struct io_sampler : boost::noncopyable
+{
+    typedef std::chrono::steady_clock clock;
+
+    io_sampler()
+        : m_ticks_per_second( details::clock_ticks_per_second() )
+        , m_uptime( 0 )
+        , m_denied( 0 )
+        , m_ticks( 0 )
+    {
+    }
+
+    /**@brief Samples the running processes
+     * @return The rates of the processes we may inspect since the previous
+     *         tick, sorted by pid. The vector is overwritten by the next tick */
+    const std::vector< io_rate > & tick()
+    {
+        const clock::time_point now = clock::now();
+        unsigned long long uptime;
+        if ( !details::read_uptime( m_ticks_per_second, uptime ) )
+            uptime = m_uptime;
+
+        m_pids.clear();
+        details::thread_procfs_directory().read_pids( m_pids );
+        std::sort( m_pids.begin(), m_pids.end() );
+
+        m_current.clear();
+        m_denied = 0;
+        for ( const pid_t pid : m_pids )
+        {
+            sample s;
+            s.pid = pid;
+            int error;
+            if ( !details::read_process_io( pid, s.counters, &error ) )
+            {
+                // the processes which exited are not counted
+                if ( error == EACCES || error == EPERM )
+                    ++m_denied;
+                continue;
+            }
+
+            process_stat stat;
+            if ( !details::read_process_stat( pid, stat ) )
+                continue;
+
+            s.start_time = stat.start_time;
+            m_current.push_back( s );
+        }
+
+        const double elapsed = std::chrono::duration< double >( now - m_time ).count();
+        const double per_second = ( m_ticks > 0 && elapsed > 0 ) ? 1.0 / elapsed : 0.0;
+
+        m_rates.clear();
+        details::match_samples( m_current, m_previous, m_uptime,
+                                [&]( const sample & s, const process_io & baseline )
+        {
+            using details::counter_delta;
+            const process_io & io = s.counters;
+
+            io_rate rate;
+            rate.pid        = s.pid;
+            rate.start_time = s.start_time;
+            rate.read       = counter_delta( io.read_bytes, baseline.read_bytes ) * per_second;
+            rate.write      = counter_delta( counter_delta( io.write_bytes, baseline.write_bytes ),
+                                             counter_delta( io.cancelled_write_bytes,
+                                                            baseline.cancelled_write_bytes ) ) * per_second;
+            rate.rchar      = counter_delta( io.rchar, baseline.rchar ) * per_second;
+            rate.wchar      = counter_delta( io.wchar, baseline.wchar ) * per_second;
+            rate.syscr      = counter_delta( io.syscr, baseline.syscr ) * per_second;
+            rate.syscw      = counter_delta( io.syscw, baseline.syscw ) * per_second;
+            m_rates.push_back( rate );
+        } );
+
+        m_previous.swap( m_current );
+        m_time = now;
+        m_uptime = uptime;
+        ++m_ticks;
+        return m_rates;
+    }
+
+    /**@brief Returns the processes with the highest rates of the last tick
+     *
+     * Processes are ranked by their storage I/O, then by the bytes they read
+     * and wrote, which include the cache hits.
+     * @param[in] count The number of processes returned, at most */
+    std::vector< io_rate > top( const std::size_t count ) const
+    {
+        std::vector< io_rate > highest( std::min( count, m_rates.size() ) );
+        std::partial_sort_copy( m_rates.begin(), m_rates.end(), highest.begin(), highest.end(),
+                                []( const io_rate & left, const io_rate & right )
+        {
+            if ( left.total() != right.total() )
+                return left.total() > right.total();
+
+            return left.rchar + left.wchar > right.rchar + right.wchar;
+        } );
+
+        return highest;
+    }
+
+    /**@brief Returns the rates computed by the last tick, sorted by pid */
+    const std::vector< io_rate > & rates() const
+    {
+        return m_rates;
+    }
+
+    /**@brief Returns the number of processes whose counters we were not allowed to read at the last tick */
+    std::size_t denied() const
+    {
+        return m_denied;
+    }
+
+    /**@brief Returns the number of ticks so far */
+    unsigned long long ticks() const
+    {
+        return m_ticks;
+    }
+
+private:
+    typedef details::process_sample< process_io > sample;
+
+    unsigned long long     m_ticks_per_second;
+    unsigned long long     m_uptime;
+    clock::time_point      m_time;
+    std::size_t            m_denied;
+    unsigned long long     m_ticks;
+    std::vector< pid_t >   m_pids;
+    std::vector< sample >  m_previous;
+    std::vector< sample >  m_current;
+    std::vector< io_rate > m_rates;
+};
+#endif
+
+} // namespace ps
+
+#endif // PS_IO_SAMPLER_H
@@ -0,0 +1,455 @@
+#ifndef PS_IO_URING_H
+#define PS_IO_URING_H
+
+#include "config.h"
+#include "ps/common.h"
+#include "ps/procfs.h"
+
+#if PS_HAVE_PROCFS && HAVE_LINUX_IO_URING_H && HAVE_SYS_MMAN_H && defined( SYS_io_uring_setup ) \
+    && HAVE_DECL_IORING_OP_OPENAT && HAVE_DECL_IORING_OP_READ && HAVE_DECL_IORING_OP_CLOSE
+#   define PS_HAVE_IO_URING 1
+#else
+#   define PS_HAVE_IO_URING 0
+#endif
+
+namespace ps
+{
+namespace details
+{
+
+#if PS_HAVE_IO_URING
+/**@struct io_uring_queue
+ * @brief A minimal io_uring submission and completion queue
+ *
+ * The kernel interface is used directly, so that no extra library is needed.
+ * If the kernel does not support io_uring, or if it is forbidden by a seccomp
+ * filter, is_open() returns false and the caller must use plain syscalls. */
+struct io_uring_queue : boost::noncopyable
+{
+    explicit
+    io_uring_queue( const unsigned entries = 256 )
+        : m_fd( -1 )
+        , m_sq_ring( MAP_FAILED )
+        , m_cq_ring( MAP_FAILED )
+        , m_sqes( MAP_FAILED )
+        , m_sq_ring_size( 0 )
+        , m_cq_ring_size( 0 )
+        , m_sqes_size( 0 )
+        , m_queued( 0 )
+        , m_syscalls( 0 )
+    {
+        io_uring_params params;
+        memset( &params, 0, sizeof( params ) );
+
+        m_fd = static_cast< int >( syscall( SYS_io_uring_setup, entries, &params ) );
+        ++m_syscalls;
+        if ( m_fd < 0 )
+        {
+            m_fd = -1;
+            return;
+        }
+
+        m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+        m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe );
+        m_sqes_size = params.sq_entries * sizeof( io_uring_sqe );
+
+        // recent kernels map both rings with a single call
+        const bool single_mmap = ( params.features & IORING_FEAT_SINGLE_MMAP ) != 0;
+        if ( single_mmap )
+            m_sq_ring_size = m_cq_ring_size = std::max( m_sq_ring_size, m_cq_ring_size );
+
+        m_sq_ring = mmap( nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING );
+        m_cq_ring = single_mmap
+                    ? m_sq_ring
+                    : mmap( nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING );
+        m_sqes    = mmap( nullptr, m_sqes_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES );
+
+        if ( m_sq_ring == MAP_FAILED || m_cq_ring == MAP_FAILED || m_sqes == MAP_FAILED )
+        {
+            release();
+            return;
+        }
+
+        char * const sq = static_cast< char * >( m_sq_ring );
+        m_sq_tail  = reinterpret_cast< unsigned * >( sq + params.sq_off.tail );
+        m_sq_mask  = *reinterpret_cast< unsigned * >( sq + params.sq_off.ring_mask );
+        m_sq_array = reinterpret_cast< unsigned * >( sq + params.sq_off.array );
+        m_sq_entries = params.sq_entries;
+
+        char * const cq = static_cast< char * >( m_cq_ring );
+        m_cq_head = reinterpret_cast< unsigned * >( cq + params.cq_off.head );
+        m_cq_tail = reinterpret_cast< unsigned * >( cq + params.cq_off.tail );
+        m_cq_mask = *reinterpret_cast< unsigned * >( cq + params.cq_off.ring_mask );
+        m_cqes    = reinterpret_cast< io_uring_cqe * >( cq + params.cq_off.cqes );
+    }
+
+    ~io_uring_queue()
+    {
+        release();
+    }
+
+    bool is_open() const
+    {
+        return m_fd != -1;
+    }
+
+    /**@brief Returns the number of requests that fit in one batch */
+    unsigned capacity() const
+    {
+        return is_open() ? m_sq_entries : 0;
+    }
+
+    /**@brief Returns the number of io_uring syscalls performed so far */
+    unsigned syscalls() const
+    {
+        return m_syscalls;
+    }
+
+    void queue_openat( const int dirfd, const char * const path,
+                       const int flags, const uint64_t user_data )
+    {
+        io_uring_sqe & sqe = next_sqe();
+        sqe.opcode     = IORING_OP_OPENAT;
+        sqe.fd         = dirfd;
+        sqe.addr       = reinterpret_cast< uintptr_t >( path );
+        sqe.open_flags = flags;
+        sqe.user_data  = user_data;
+    }
+
+    void queue_read( const int fd, char * const buffer, const unsigned size,
+                     const uint64_t user_data )
+    {
+        io_uring_sqe & sqe = next_sqe();
+        sqe.opcode    = IORING_OP_READ;
+        sqe.fd        = fd;
+        sqe.addr      = reinterpret_cast< uintptr_t >( buffer );
+        sqe.len       = size;
+        sqe.user_data = user_data;
+    }
+
+    void queue_close( const int fd, const uint64_t user_data )
+    {
+        io_uring_sqe & sqe = next_sqe();
+        sqe.opcode    = IORING_OP_CLOSE;
+        sqe.fd        = fd;
+        sqe.user_data = user_data;
+    }
+
+    /**@brief Submits every queued request and waits for all of them to complete
+     *
+     * on_completion( user_data, result ) is called once per request, result being
+     * what the equivalent syscall would have returned, or -errno.
+     * @return false if the ring failed, in which case some completions are lost */
+    template< typename OnCompletion >
+    bool run( OnCompletion on_completion )
+    {
+        unsigned to_submit = m_queued;
+        unsigned pending = m_queued;
+        m_queued = 0;
+
+        // the entries are complete, hand them over to the kernel
+        __atomic_store_n( m_sq_tail, *m_sq_tail + to_submit, __ATOMIC_RELEASE );
+
+        while ( pending != 0 )
+        {
+            const int submitted = static_cast< int >(
+                syscall( SYS_io_uring_enter, m_fd, to_submit, 1,
+                         IORING_ENTER_GETEVENTS, nullptr, 0 ) );
+            ++m_syscalls;
+
+            if ( submitted < 0 )
+            {
+                if ( errno == EINTR || errno == EAGAIN || errno == EBUSY )
+                    continue;
+                return false;
+            }
+            to_submit -= submitted;
+
+            unsigned head = *m_cq_head;
+            const unsigned tail = __atomic_load_n( m_cq_tail, __ATOMIC_ACQUIRE );
+            for ( ; head != tail; ++head, --pending )
+            {
+                const io_uring_cqe & cqe = m_cqes[head & m_cq_mask];
+                on_completion( cqe.user_data, cqe.res );
+            }
+            __atomic_store_n( m_cq_head, head, __ATOMIC_RELEASE );
+        }
+
+        return true;
+    }
+
+private:
+    io_uring_sqe & next_sqe()
+    {
+        assert( is_open() );
+        assert( m_queued < m_sq_entries );
+
+        const unsigned index = ( *m_sq_tail + m_queued ) & m_sq_mask;
+
+        io_uring_sqe & sqe = static_cast< io_uring_sqe * >( m_sqes )[index];
+        memset( &sqe, 0, sizeof( sqe ) );
+        m_sq_array[index] = index;
+
+        ++m_queued;
+        return sqe;
+    }
+
+    void release()
+    {
+        if ( m_sqes != MAP_FAILED )
+            munmap( m_sqes, m_sqes_size );
+        if ( m_cq_ring != MAP_FAILED && m_cq_ring != m_sq_ring )
+            munmap( m_cq_ring, m_cq_ring_size );
+        if ( m_sq_ring != MAP_FAILED )
+            munmap( m_sq_ring, m_sq_ring_size );
+        if ( m_fd != -1 )
+            close( m_fd );
+
+        m_sqes = m_cq_ring = m_sq_ring = MAP_FAILED;
+        m_fd = -1;
+    }
+
+    int            m_fd;
+    void *         m_sq_ring;
+    void *         m_cq_ring;
+    void *         m_sqes;
+    std::size_t    m_sq_ring_size;
+    std::size_t    m_cq_ring_size;
+    std::size_t    m_sqes_size;
+
+    unsigned *     m_sq_tail;
+    unsigned *     m_sq_array;
+    unsigned       m_sq_mask;
+    unsigned       m_sq_entries;
+
+    unsigned *     m_cq_head;
+    unsigned *     m_cq_tail;
+    unsigned       m_cq_mask;
+    io_uring_cqe * m_cqes;
+
+    unsigned       m_queued;
+    unsigned       m_syscalls;
+};
+
+/**@struct procfs_batch_reader
+ * @brief Reads the same file of many processes with a few io_uring calls
+ *
+ * For every batch of pids, all the opens are submitted at once, then
+ * all the reads, then all the closes: three syscalls per batch instead of
+ * at least three per process. */
+struct procfs_batch_reader : boost::noncopyable
+{
+    explicit
+    procfs_batch_reader( const unsigned batch_size = 256,
+                         const unsigned read_size = 4096 )
+        : m_ring( batch_size )
+        , m_read_size( read_size )
+        , m_paths( m_ring.capacity() )
+        , m_buffers( m_ring.capacity() * read_size )
+        , m_fds( m_ring.capacity() )
+        , m_lengths( m_ring.capacity() )
+        , m_broken( false )
+    {
+    }
+
+    bool is_open() const
+    {
+        return m_ring.is_open() && !m_broken;
+    }
+
+    /**@brief Returns the number of io_uring syscalls performed so far */
+    unsigned syscalls() const
+    {
+        return m_ring.syscalls();
+    }
+
+    /**@brief Reads the first line of /proc/<pid>/<file_name> for every pid,
+     *        keeping at most max_size bytes of each
+     *
+     * contents and found must have as many elements as there are pids.
+     * @return false if io_uring failed and the reads must be done synchronously */
+    bool read( const pid_t * const pids, const std::size_t count,
+               const char * const file_name, const std::size_t max_size,
+               std::string * const contents, char * const found )
+    {
+        if ( !is_open() )
+            return false;
+
+        for ( std::size_t first = 0; first < count; first += m_ring.capacity() )
+        {
+            const std::size_t batch =
+                std::min< std::size_t >( count - first, m_ring.capacity() );
+
+            // the ring is in an unknown state after a failure, do not reuse it
+            if ( !read_batch( pids + first, batch, file_name, max_size,
+                              contents + first, found + first ) )
+            {
+                m_broken = true;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+private:
+    bool read_batch( const pid_t * const pids, const std::size_t count,
+                     const char * const file_name, const std::size_t max_size,
+                     std::string * const contents, char * const found )
+    {
+        bool supported = true;
+        const auto store = [&]( const uint64_t i, const int result, std::vector< int > & out )
+        {
+            // old kernels know io_uring but not these opcodes
+            if ( result == -EINVAL )
+                supported = false;
+            out[i] = result;
+        };
+
+        for ( std::size_t i = 0; i < count; ++i )
+        {
+            format_procfs_path( m_paths[i].path, pids[i], file_name );
+            m_ring.queue_openat( procfs_dirfd(), m_paths[i].path, O_RDONLY | O_CLOEXEC, i );
+            found[i] = false;
+            // only the opens that complete hand back a descriptor
+            m_fds[i] = -1;
+        }
+        if ( !m_ring.run( [&]( uint64_t i, int fd ) { store( i, fd, m_fds ); } ) )
+        {
+            close_all( count );
+            return false;
+        }
+
+        unsigned opened = 0;
+        for ( std::size_t i = 0; i < count; ++i )
+        {
+            if ( m_fds[i] < 0 )
+                continue;
+
+            m_ring.queue_read( m_fds[i], &m_buffers[i * m_read_size], m_read_size, i );
+            ++opened;
+        }
+        if ( opened && !m_ring.run( [&]( uint64_t i, int length ) { store( i, length, m_lengths ); } ) )
+        {
+            close_all( count );
+            return false;
+        }
+
+        for ( std::size_t i = 0; i < count; ++i )
+        {
+            if ( m_fds[i] < 0 )
+                continue;
+
+            found[i] = m_lengths[i] >= 0;
+            if ( found[i] )
+                assign_first_line( m_fds[i], &m_buffers[i * m_read_size], m_lengths[i],
+                                   max_size, contents[i] );
+
+            m_ring.queue_close( m_fds[i], i );
+        }
+        // forget the descriptors as their closes complete, so that a failed pass
+        // leaves behind only those still to be closed
+        if ( opened && !m_ring.run( [this]( uint64_t i, int ) { m_fds[i] = -1; } ) )
+        {
+            close_all( count );
+            return false;
+        }
+
+        return supported;
+    }
+
+    // synchronously closes the descriptors a failed pass left open
+    void close_all( const std::size_t count )
+    {
+        for ( std::size_t i = 0; i < count; ++i )
+        {
+            if ( m_fds[i] >= 0 )
+                close( m_fds[i] );
+            m_fds[i] = -1;
+        }
+    }
+
+    // keeps the first line of the file, like read_procfs_file() does
+    void assign_first_line( const int fd, const char * const buffer, const int length,
+                            const std::size_t max_size, std::string & contents ) const
+    {
+        const char * const end = buffer + std::min< std::size_t >( length, max_size );
+        const char * const newline = std::find( buffer, end, '\n' );
+        contents.assign( buffer, newline );
+
+        // the buffer was too small: read the rest of the line synchronously. The
+        // ring read was positional and left the file offset at 0, so move past
+        // what it read first
+        if ( newline == end && static_cast< unsigned >( length ) == m_read_size &&
+             lseek( fd, length, SEEK_SET ) == length )
+            append_first_line( fd, contents, max_size );
+    }
+
+    struct procfs_path
+    {
+        char path[PROCFS_PATH_SIZE];
+    };
+
+    io_uring_queue      m_ring;
+    const unsigned      m_read_size;
+    std::vector< procfs_path > m_paths;
+    std::vector< char > m_buffers;
+    std::vector< int >  m_fds;
+    std::vector< int >  m_lengths;
+    bool                m_broken;
+};
+#endif
+
+/**@brief Reads the first line of /proc/<pid>/<file_name> for a range of pids,
+ *        keeping at most max_size bytes of each
+ *
+ * Uses io_uring when it is available, and falls back to one synchronous
+ * read per process otherwise.
+ * @return The number of syscalls performed through io_uring, 0 if the
+ *         synchronous path was taken */
+static inline
+unsigned read_procfs_files( const pid_t * const pids, const std::size_t count,
+                            const char * const file_name,
+                            std::string * const contents, char * const found,
+                            const bool use_io_uring,
+                            const std::size_t max_size = PROCFS_READ_LIMIT )
+{
+#if PS_HAVE_IO_URING
+    if ( use_io_uring )
+    {
+        // one ring per thread. The workers of parallel_for only live for one
+        // capture, so only the ring of the calling thread is kept for the next
+        static thread_local procfs_batch_reader reader;
+        const unsigned syscalls_before = reader.syscalls();
+        if ( reader.read( pids, count, file_name, max_size, contents, found ) )
+            return reader.syscalls() - syscalls_before;
+    }
+#else
+    ( void )use_io_uring;
+#endif
+
+    for ( std::size_t i = 0; i < count; ++i )
+        found[i] = read_procfs_file( pids[i], file_name, contents[i], max_size );
+
+    return 0;
+}
+
+} // ns details
+
+/**@brief Checks whether the io_uring backend can be used on this machine */
+inline
+bool has_io_uring()
+{
+#if PS_HAVE_IO_URING
+    return details::io_uring_queue( 1 ).is_open();
+#else
+    return false;
+#endif
+}
+
+} // namespace ps
+
+#endif // PS_IO_URING_H
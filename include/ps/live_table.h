@@ -0,0 +1,436 @@
+#ifndef PS_LIVE_TABLE_H
+#define PS_LIVE_TABLE_H
+
+#include "config.h"
+#include "ps/common.h"
+#include "ps/process.h"
+#include "ps/procfs.h"
+#include "ps/snapshot.h"
+
+#if HAVE_THREAD && HAVE_MUTEX && HAVE_ATOMIC && HAVE_CHRONO && HAVE_MAP && HAVE_POLL_H && PS_HAVE_PROCFS
+#   define PS_HAVE_LIVE_TABLE 1
+#else
+#   define PS_HAVE_LIVE_TABLE 0
+#endif
+
+#if PS_HAVE_LIVE_TABLE && HAVE_SYS_SOCKET_H && HAVE_LINUX_NETLINK_H \
+    && HAVE_LINUX_CONNECTOR_H && HAVE_LINUX_CN_PROC_H
+#   define PS_HAVE_PROC_CONNECTOR 1
+#else
+#   define PS_HAVE_PROC_CONNECTOR 0
+#endif
+
+namespace ps
+{
+
+#if PS_HAVE_LIVE_TABLE
+/**@struct live_table
+ * @brief A process table which is kept up to date in the background
+ *
+ * The table is seeded from one scan of /proc, then updated from the fork,
+ * exec, exit and comm events of the linux proc connector, so short-lived
+ * processes are seen and the cost follows the rate of change rather than
+ * the number of processes.
+ *
+ * Listening to the proc connector requires CAP_NET_ADMIN, in the initial user
+ * and pid namespaces. Unless the kernel confirms the subscription within half
+ * a second, the table falls back to polling /proc with capture_delta(). */
+struct live_table : boost::noncopyable
+{
+    /**@struct statistics
+     * @brief Tells how well the table keeps up with the kernel */
+    struct statistics
+    {
+        unsigned long long       events;  ///< changes applied to the table so far
+        unsigned long long       drops;   ///< times events were lost, forcing a rescan of /proc
+        std::chrono::nanoseconds lag;     ///< delay of the last change, between the kernel and the table
+        std::chrono::nanoseconds max_lag; ///< the largest such delay so far
+    };
+
+    /**@brief Seeds the table and starts following the running processes
+     * @param[in] poll_interval How often /proc is scanned when the proc connector is unavailable */
+    explicit
+    live_table( std::chrono::milliseconds poll_interval = std::chrono::milliseconds( 1000 ) )
+        : m_poll_interval( poll_interval )
+        , m_socket( -1 )
+        , m_stop( false )
+        , m_events( 0 )
+        , m_drops( 0 )
+        , m_lag( 0 )
+        , m_max_lag( 0 )
+    {
+        m_wakeup[0] = m_wakeup[1] = -1;
+        if ( pipe2( m_wakeup, O_CLOEXEC ) != 0 )
+            m_wakeup[0] = m_wakeup[1] = -1;
+
+        // subscribe first, so that nothing is missed while /proc is scanned. The
+        // events are waited for without a timeout, which only the wakeup pipe can
+        // interrupt: without it, /proc is polled instead
+        if ( m_wakeup[0] != -1 )
+            m_socket = subscribe();
+        rescan();
+
+        m_thread = std::thread( [this]()
+        {
+            if ( m_socket != -1 )
+                follow_events();
+            else
+                poll_procfs();
+        } );
+    }
+
+    ~live_table()
+    {
+        m_stop = true;
+        if ( m_wakeup[1] != -1 )
+        {
+            const char wake = 0;
+            while ( write( m_wakeup[1], &wake, 1 ) < 0 && errno == EINTR )
+                ;
+        }
+
+        m_thread.join();
+
+        if ( m_socket != -1 )
+            close( m_socket );
+        if ( m_wakeup[0] != -1 )
+            close( m_wakeup[0] );
+        if ( m_wakeup[1] != -1 )
+            close( m_wakeup[1] );
+    }
+
+    /**@brief Returns a consistent copy of the table, sorted by pid */
+    snapshot view() const
+    {
+        std::lock_guard< std::mutex > lock( m_mutex );
+
+        snapshot processes;
+        processes.reserve( m_processes.size() );
+        for ( const auto & entry : m_processes )
+            processes.push_back( entry.second );
+
+        return processes;
+    }
+
+    /**@brief Returns the number of processes in the table */
+    std::size_t size() const
+    {
+        std::lock_guard< std::mutex > lock( m_mutex );
+        return m_processes.size();
+    }
+
+    /**@brief Checks whether the table follows kernel events, rather than polling /proc */
+    bool is_event_driven() const
+    {
+        return m_socket != -1;
+    }
+
+    statistics stats() const
+    {
+        statistics result;
+        result.events  = m_events;
+        result.drops   = m_drops;
+        result.lag     = std::chrono::nanoseconds( m_lag.load() );
+        result.max_lag = std::chrono::nanoseconds( m_max_lag.load() );
+        return result;
+    }
+
+private:
+    static
+    long long monotonic_ns()
+    {
+        timespec now;
+        clock_gettime( CLOCK_MONOTONIC, &now );
+        return now.tv_sec * 1000000000LL + now.tv_nsec;
+    }
+
+    void record_lag( const long long lag )
+    {
+        m_lag = lag;
+        if ( lag > m_max_lag )
+            m_max_lag = lag;
+    }
+
+    // returns a netlink socket subscribed to the proc connector, or -1
+    static
+    int subscribe()
+    {
+#if PS_HAVE_PROC_CONNECTOR
+        const int fd = socket( PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR );
+        if ( fd == -1 )
+            return -1;
+
+        sockaddr_nl address;
+        memset( &address, 0, sizeof( address ) );
+        address.nl_family = AF_NETLINK;
+        address.nl_groups = CN_IDX_PROC;
+        address.nl_pid    = 0;
+
+        // fails with EPERM without CAP_NET_ADMIN
+        if ( bind( fd, reinterpret_cast< sockaddr * >( &address ), sizeof( address ) ) != 0 )
+        {
+            close( fd );
+            return -1;
+        }
+
+        // a netlink header, followed by a connector message holding the operation
+        alignas( nlmsghdr ) char request[NLMSG_SPACE( sizeof( cn_msg ) + sizeof( proc_cn_mcast_op ) )];
+        memset( request, 0, sizeof( request ) );
+
+        nlmsghdr * const header = reinterpret_cast< nlmsghdr * >( request );
+        header->nlmsg_len  = NLMSG_LENGTH( sizeof( cn_msg ) + sizeof( proc_cn_mcast_op ) );
+        header->nlmsg_type = NLMSG_DONE;
+        header->nlmsg_pid  = 0;
+
+        cn_msg * const message = static_cast< cn_msg * >( NLMSG_DATA( header ) );
+        message->id.idx = CN_IDX_PROC;
+        message->id.val = CN_VAL_PROC;
+        message->len    = sizeof( proc_cn_mcast_op );
+
+        const proc_cn_mcast_op operation = PROC_CN_MCAST_LISTEN;
+        memcpy( message->data, &operation, sizeof( operation ) );
+
+        // bind() and send() may succeed while no event will ever come, as for a
+        // process outside the initial user or pid namespace
+        if ( send( fd, request, header->nlmsg_len, 0 ) < 0 || !confirm_subscription( fd ) )
+        {
+            close( fd );
+            return -1;
+        }
+
+        return fd;
+#else
+        return -1;
+#endif
+    }
+
+#if PS_HAVE_PROC_CONNECTOR
+    // waits for the kernel to acknowledge PROC_CN_MCAST_LISTEN. The kernel does
+    // not answer the requests it ignores, like those from outside the initial
+    // namespaces. Events may reach the socket anyway, but only for as long as
+    // somebody else listens, so they do not count as a confirmation
+    static
+    bool confirm_subscription( const int fd )
+    {
+        const long long deadline = monotonic_ns() + 500 * 1000000LL;
+        alignas( nlmsghdr ) char buffer[16 * 1024];
+
+        for ( ;; )
+        {
+            const long long remaining = deadline - monotonic_ns();
+            if ( remaining <= 0 )
+                return false;
+
+            pollfd readable;
+            readable.fd = fd;
+            readable.events = POLLIN;
+            const int ready = poll( &readable, 1, static_cast< int >( remaining / 1000000 ) + 1 );
+            if ( ready < 0 && errno != EINTR )
+                return false;
+
+            if ( ready <= 0 )
+                continue;
+
+            const ssize_t length = recv( fd, buffer, sizeof( buffer ), MSG_DONTWAIT );
+            if ( length <= 0 )
+                continue;
+
+            int left = static_cast< int >( length );
+            for ( nlmsghdr * header = reinterpret_cast< nlmsghdr * >( buffer );
+                  NLMSG_OK( header, left );
+                  header = NLMSG_NEXT( header, left ) )
+            {
+                if ( header->nlmsg_type == NLMSG_ERROR || header->nlmsg_type == NLMSG_NOOP )
+                    continue;
+
+                const cn_msg * const message = static_cast< const cn_msg * >( NLMSG_DATA( header ) );
+                if ( message->id.idx != CN_IDX_PROC || message->id.val != CN_VAL_PROC )
+                    continue;
+
+                // the events received here are covered by the scan of /proc which follows
+                const proc_event & event = *reinterpret_cast< const proc_event * >( message->data );
+                if ( event.what == proc_event::PROC_EVENT_NONE )
+                    return event.event_data.ack.err == 0;
+            }
+        }
+    }
+#endif
+
+    // replaces the whole table with a fresh scan of /proc
+    void rescan()
+    {
+        const snapshot_delta delta = capture_delta( snapshot() );
+
+        std::lock_guard< std::mutex > lock( m_mutex );
+        m_processes.clear();
+        for ( const process & p : delta.current )
+            m_processes.insert( std::make_pair( p.pid(), p ) );
+    }
+
+    // reads a process which was just forked or which just executed a program
+    void refresh( const pid_t pid )
+    {
+        details::stat_identity identity;
+        std::string cmdline;
+        const bool alive = details::read_stat_identity( pid, identity )
+                           && details::read_procfs_file( pid, "cmdline", cmdline );
+
+        std::lock_guard< std::mutex > lock( m_mutex );
+        if ( !alive )
+        {
+            m_processes.erase( pid );
+            return;
+        }
+
+        m_processes[pid] = process( pid, cmdline, "", identity.comm, "", identity.start_time );
+    }
+
+    void forget( const pid_t pid )
+    {
+        std::lock_guard< std::mutex > lock( m_mutex );
+        m_processes.erase( pid );
+    }
+
+    // waits until fd is readable or the table is destroyed
+    bool wait_for( const int fd, const int timeout_ms )
+    {
+        pollfd fds[2];
+        fds[0].fd = m_wakeup[0];
+        fds[0].events = POLLIN;
+        fds[1].fd = fd;
+        fds[1].events = POLLIN;
+
+        const int ready = poll( fds, fd == -1 ? 1 : 2, timeout_ms );
+        return ready > 0 && !m_stop && ( fds[1].revents & POLLIN );
+    }
+
+    void poll_procfs()
+    {
+        snapshot current = view();
+        const int interval = static_cast< int >( m_poll_interval.count() );
+
+        while ( !m_stop )
+        {
+            wait_for( -1, interval );
+            if ( m_stop )
+                return;
+
+            const long long start = monotonic_ns();
+            snapshot_delta delta = capture_delta( current );
+            current.swap( delta.current );
+
+            {
+                std::lock_guard< std::mutex > lock( m_mutex );
+                for ( const process & p : delta.exited )
+                    m_processes.erase( p.pid() );
+                for ( const process & p : delta.added )
+                    m_processes[p.pid()] = p;
+                for ( const process & p : delta.changed )
+                    m_processes[p.pid()] = p;
+            }
+
+            // a change may have happened right after the previous scan
+            m_events += delta.exited.size() + delta.added.size() + delta.changed.size();
+            record_lag( monotonic_ns() - start + m_poll_interval.count() * 1000000LL );
+        }
+    }
+
+    void follow_events()
+    {
+#if PS_HAVE_PROC_CONNECTOR
+        alignas( nlmsghdr ) char buffer[16 * 1024];
+
+        while ( !m_stop )
+        {
+            if ( !wait_for( m_socket, -1 ) )
+                continue;
+
+            const ssize_t length = recv( m_socket, buffer, sizeof( buffer ), 0 );
+            if ( length < 0 && errno == ENOBUFS )
+            {
+                // the socket overflowed: some events are lost for good
+                ++m_drops;
+                rescan();
+                continue;
+            }
+
+            if ( length <= 0 )
+                continue;
+
+            int remaining = static_cast< int >( length );
+            for ( nlmsghdr * header = reinterpret_cast< nlmsghdr * >( buffer );
+                  NLMSG_OK( header, remaining );
+                  header = NLMSG_NEXT( header, remaining ) )
+            {
+                if ( header->nlmsg_type == NLMSG_ERROR || header->nlmsg_type == NLMSG_NOOP )
+                    continue;
+
+                const cn_msg * const message = static_cast< const cn_msg * >( NLMSG_DATA( header ) );
+                if ( message->id.idx != CN_IDX_PROC || message->id.val != CN_VAL_PROC )
+                    continue;
+
+                apply( *reinterpret_cast< const proc_event * >( message->data ) );
+            }
+        }
+#endif
+    }
+
+#if PS_HAVE_PROC_CONNECTOR
+    void apply( const proc_event & event )
+    {
+        // threads are reported too, but only processes belong in the table
+        switch ( event.what )
+        {
+        case proc_event::PROC_EVENT_FORK:
+            if ( event.event_data.fork.child_pid != event.event_data.fork.child_tgid )
+                return;
+            refresh( event.event_data.fork.child_tgid );
+            break;
+
+        case proc_event::PROC_EVENT_EXEC:
+            refresh( event.event_data.exec.process_tgid );
+            break;
+
+        case proc_event::PROC_EVENT_COMM:
+            if ( event.event_data.comm.process_pid != event.event_data.comm.process_tgid )
+                return;
+            refresh( event.event_data.comm.process_tgid );
+            break;
+
+        case proc_event::PROC_EVENT_EXIT:
+            if ( event.event_data.exit.process_pid != event.event_data.exit.process_tgid )
+                return;
+            forget( event.event_data.exit.process_tgid );
+            break;
+
+        default:
+            return;
+        }
+
+        ++m_events;
+
+        // the kernel stamps events with the monotonic time since boot
+        record_lag( monotonic_ns() - static_cast< long long >( event.timestamp_ns ) );
+    }
+#endif
+
+    mutable std::mutex          m_mutex;
+    std::map< pid_t, process >  m_processes;
+
+    const std::chrono::milliseconds m_poll_interval;
+    int                         m_socket;
+    int                         m_wakeup[2];
+    std::atomic< bool >         m_stop;
+
+    std::atomic< unsigned long long > m_events;
+    std::atomic< unsigned long long > m_drops;
+    std::atomic< long long >    m_lag;
+    std::atomic< long long >    m_max_lag;
+
+    std::thread                 m_thread;
+};
+#endif
+
+} // namespace ps
+
+#endif // PS_LIVE_TABLE_H
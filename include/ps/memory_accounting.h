@@ -0,0 +1,312 @@
+#ifndef PS_MEMORY_ACCOUNTING_H
+#define PS_MEMORY_ACCOUNTING_H
+
+#include "config.h"
+#include "ps/common.h"
+#include "ps/procfs.h"
+#include "ps/snapshot.h"
+#include "ps/worker_pool.h"
+
+namespace ps
+{
+
+/**@struct proportional_memory
+ * @brief The memory of a process, with its shared pages split between the processes sharing them
+ *
+ * The resident set size counts a page shared by ten processes ten times. The
+ * proportional set size charges a tenth of it to each of them, so that the
+ * PSS of a group of processes adds up to the memory they use together. The
+ * unique set size only counts the pages no other process maps, which is what
+ * killing the process would free. All sizes are in bytes. */
+struct proportional_memory
+{
+    proportional_memory()
+        : pid( INVALID_PID )
+        , rss( 0 )
+        , pss( 0 )
+        , uss( 0 )
+        , swap( 0 )
+        , swap_pss( 0 )
+    {
+    }
+
+    pid_t              pid;
+    unsigned long long rss;      ///< the resident set size
+    unsigned long long pss;      ///< the proportional set size
+    unsigned long long uss;      ///< the unique set size: the private pages, clean or dirty
+    unsigned long long swap;     ///< the memory swapped out
+    unsigned long long swap_pss; ///< the memory swapped out, with shared pages split as for pss
+};
+
+/**@brief Where account_memory() reads the mappings of a process from */
+enum smaps_source
+{
+    SMAPS_ROLLUP = 0x0, ///< /proc/<pid>/smaps_rollup, or smaps on kernels older than 4.14
+    SMAPS_FULL   = 0x1  ///< /proc/<pid>/smaps, summing every mapping
+};
+
+/**@struct memory_accounting
+ * @brief The proportional memory of a set of processes, and their total */
+struct memory_accounting
+{
+    memory_accounting()
+        : unreadable( 0 )
+        , rollups( 0 )
+    {
+    }
+
+    std::vector< proportional_memory > processes;  ///< in the order the pids were given
+    proportional_memory                total;      ///< the sum of processes, whose pid is INVALID_PID
+    std::size_t                        unreadable; ///< the processes which exited, or which we may not inspect
+    std::size_t                        rollups;    ///< the processes read from smaps_rollup
+};
+
+namespace details
+{
+
+// the longest line kept across two reads. Only the beginning of the lines
+// matters: the counters are short, and the mappings are skipped
+static PS_CONSTEXPR std::size_t SMAPS_LINE_SIZE = 64;
+
+/**@struct smaps_parser
+ * @brief Sums the counters of smaps or smaps_rollup, fed one read at a time
+ *
+ * smaps has a block of counters per mapping, and can weigh megabytes for a
+ * large process, so it is parsed as it is read instead of being loaded
+ * whole. smaps_rollup has a single block, already summed by the kernel. */
+struct smaps_parser
+{
+    explicit
+    smaps_parser( proportional_memory & memory )
+        : m_memory( memory )
+        , m_carried( 0 )
+    {
+    }
+
+    void feed( const char * data, const std::size_t length )
+    {
+        const char * const end = data + length;
+        while ( data != end )
+        {
+            const char * const newline = static_cast< const char * >( memchr( data, '\n', end - data ) );
+            const char * const line_end = newline ? newline : end;
+
+            if ( m_carried == 0 && newline )
+                parse_line( data, line_end );
+            else
+            {
+                // the line is split between two reads
+                const std::size_t kept = std::min< std::size_t >( SMAPS_LINE_SIZE - m_carried, line_end - data );
+                memcpy( m_line + m_carried, data, kept );
+                m_carried += kept;
+
+                if ( newline )
+                {
+                    parse_line( m_line, m_line + m_carried );
+                    m_carried = 0;
+                }
+            }
+
+            data = newline ? newline + 1 : end;
+        }
+    }
+
+    // parses the last line, if the file does not end with a newline
+    void finish()
+    {
+        if ( m_carried != 0 )
+            parse_line( m_line, m_line + m_carried );
+
+        m_carried = 0;
+    }
+
+private:
+    // parses "Pss:    372 kB"
+    void parse_line( const char * const line, const char * const end )
+    {
+        const char * const colon = std::find( line, end, ':' );
+        if ( colon == end )
+            return;
+
+        unsigned long long * field = nullptr;
+        switch ( colon - line )
+        {
+        case 3:
+            if ( memcmp( line, "Rss", 3 ) == 0 )
+                field = &m_memory.rss;
+            else if ( memcmp( line, "Pss", 3 ) == 0 )
+                field = &m_memory.pss;
+            break;
+        case 4:
+            if ( memcmp( line, "Swap", 4 ) == 0 )
+                field = &m_memory.swap;
+            break;
+        case 7:
+            if ( memcmp( line, "SwapPss", 7 ) == 0 )
+                field = &m_memory.swap_pss;
+            break;
+        case 13:
+            if ( memcmp( line, "Private_Clean", 13 ) == 0 || memcmp( line, "Private_Dirty", 13 ) == 0 )
+                field = &m_memory.uss;
+            break;
+        }
+
+        if ( !field )
+            return;
+
+        const char * position = colon + 1;
+        while ( position != end && *position == ' ' )
+            ++position;
+
+        unsigned long long kilobytes = 0;
+        for ( ; position != end && *position >= '0' && *position <= '9'; ++position )
+            kilobytes = kilobytes * 10 + ( *position - '0' );
+
+        *field += kilobytes * 1024;
+    }
+
+    proportional_memory & m_memory;
+    char                  m_line[SMAPS_LINE_SIZE];
+    std::size_t           m_carried;
+};
+
+// sums /proc/<pid>/<file_name>, read through the scratch buffer of the calling thread
+static inline
+bool read_smaps( const pid_t pid, const char * const file_name, proportional_memory & memory )
+{
+#if PS_HAVE_PROCFS
+    if ( pid == INVALID_PID )
+        return false;
+
+    char path[PROCFS_PATH_SIZE];
+    format_procfs_path( path, pid, file_name );
+
+    // fails if the process is gone, or if we may not ptrace it
+    const file_descriptor file( openat( procfs_dirfd(), path, O_RDONLY | O_CLOEXEC ) );
+    if ( file.get() == -1 )
+        return false;
+
+    memory = proportional_memory();
+    memory.pid = pid;
+
+    smaps_parser parser( memory );
+    char * const scratch = procfs_scratch_buffer();
+    for ( ;; )
+    {
+        const ssize_t length = ::read( file.get(), scratch, PROCFS_SCRATCH_SIZE );
+        if ( length < 0 && errno == EINTR )
+            continue;
+
+        if ( length < 0 )
+            return false;
+
+        if ( length == 0 )
+            break;
+
+        parser.feed( scratch, static_cast< std::size_t >( length ) );
+    }
+
+    parser.finish();
+    return true;
+#else
+    ( void )pid;
+    ( void )file_name;
+    ( void )memory;
+    return false;
+#endif
+}
+
+// reads the proportional memory of a process. rollup tells whether
+// smaps_rollup was read, rather than smaps
+static inline
+bool read_proportional_memory( const pid_t pid, const smaps_source source,
+                               proportional_memory & memory, bool & rollup )
+{
+    rollup = false;
+    if ( source == SMAPS_ROLLUP )
+    {
+        if ( read_smaps( pid, "smaps_rollup", memory ) )
+        {
+            rollup = true;
+            return true;
+        }
+
+        // any other error would be the same for smaps
+        if ( errno != ENOENT )
+            return false;
+    }
+
+    return read_smaps( pid, "smaps", memory );
+}
+
+} // ns details
+
+/**@brief Reads the proportional memory of processes
+ *
+ * This is much more expensive than the memory of a capture, which comes from
+ * statm: the kernel walks the page tables of every process to split their
+ * shared pages, and only our own processes may be inspected unless we have
+ * CAP_SYS_PTRACE. The reads are spread over a pool of threads.
+ * @param[in] pids The processes to read
+ * @param[in] options How many threads read /proc concurrently
+ * @param[in] source Whether to read the summary of smaps_rollup, or every mapping of smaps */
+inline
+memory_accounting account_memory( const std::vector< pid_t > & pids,
+                                  const parallel_options & options = parallel_options(),
+                                  const smaps_source source = SMAPS_ROLLUP )
+{
+    using namespace ps::details;
+    memory_accounting accounting;
+
+    std::vector< proportional_memory > memories( pids.size() );
+    std::vector< char > read( pids.size(), 0 );
+    std::vector< char > rollups( pids.size(), 0 );
+
+    // every pid has its own slot, so that workers never share any state
+    parallel_for( pids.size(), options, [&]( const std::size_t i )
+    {
+        bool rollup;
+        read[i] = read_proportional_memory( pids[i], source, memories[i], rollup );
+        rollups[i] = rollup;
+    } );
+
+    accounting.processes.reserve( pids.size() );
+    for ( std::size_t i = 0; i < pids.size(); ++i )
+    {
+        if ( !read[i] )
+        {
+            ++accounting.unreadable;
+            continue;
+        }
+
+        const proportional_memory & memory = memories[i];
+        accounting.total.rss      += memory.rss;
+        accounting.total.pss      += memory.pss;
+        accounting.total.uss      += memory.uss;
+        accounting.total.swap     += memory.swap;
+        accounting.total.swap_pss += memory.swap_pss;
+        accounting.rollups        += rollups[i];
+        accounting.processes.push_back( memory );
+    }
+
+    return accounting;
+}
+
+/**@brief Reads the proportional memory of the processes of a snapshot
+ * @see account_memory( const std::vector< pid_t > &, const parallel_options &, smaps_source ) */
+inline
+memory_accounting account_memory( const snapshot & processes,
+                                  const parallel_options & options = parallel_options(),
+                                  const smaps_source source = SMAPS_ROLLUP )
+{
+    std::vector< pid_t > pids;
+    pids.reserve( processes.size() );
+    for ( const process & p : processes )
+        pids.push_back( p.pid() );
+
+    return account_memory( pids, options, source );
+}
+
+} // namespace ps
+
+#endif // PS_MEMORY_ACCOUNTING_H
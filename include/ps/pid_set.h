@@ -0,0 +1,436 @@
+#ifndef PS_PID_SET_H
+#define PS_PID_SET_H
+
+#include "config.h"
+#include "ps/common.h"
+#include "ps/process.h"
+#include "ps/snapshot.h"
+
+#if HAVE_IMMINTRIN_H && defined( __AVX2__ )
+#   define PS_HAVE_AVX2 1
+#else
+#   define PS_HAVE_AVX2 0
+#endif
+
+#if HAVE_EMMINTRIN_H && defined( __SSE2__ )
+#   define PS_HAVE_SSE2 1
+#else
+#   define PS_HAVE_SSE2 0
+#endif
+
+namespace ps
+{
+namespace details
+{
+
+static inline
+unsigned popcount( const uint64_t word )
+{
+#if defined( __GNUC__ )
+    return static_cast< unsigned >( __builtin_popcountll( word ) );
+#else
+    uint64_t x = word - ( ( word >> 1 ) & 0x5555555555555555ULL );
+    x = ( x & 0x3333333333333333ULL ) + ( ( x >> 2 ) & 0x3333333333333333ULL );
+    x = ( x + ( x >> 4 ) ) & 0x0f0f0f0f0f0f0f0fULL;
+    return static_cast< unsigned >( ( x * 0x0101010101010101ULL ) >> 56 );
+#endif
+}
+
+// the position of the lowest bit set, word must not be 0
+static inline
+unsigned lowest_bit( const uint64_t word )
+{
+#if defined( __GNUC__ )
+    return static_cast< unsigned >( __builtin_ctzll( word ) );
+#else
+    unsigned bit = 0;
+    while ( !( word & ( 1ULL << bit ) ) )
+        ++bit;
+    return bit;
+#endif
+}
+
+struct bitwise_or
+{
+#if PS_HAVE_AVX2
+    static __m256i apply( const __m256i left, const __m256i right )
+    {
+        return _mm256_or_si256( left, right );
+    }
+#elif PS_HAVE_SSE2
+    static __m128i apply( const __m128i left, const __m128i right )
+    {
+        return _mm_or_si128( left, right );
+    }
+#endif
+
+    static uint64_t apply( const uint64_t left, const uint64_t right )
+    {
+        return left | right;
+    }
+};
+
+struct bitwise_and
+{
+#if PS_HAVE_AVX2
+    static __m256i apply( const __m256i left, const __m256i right )
+    {
+        return _mm256_and_si256( left, right );
+    }
+#elif PS_HAVE_SSE2
+    static __m128i apply( const __m128i left, const __m128i right )
+    {
+        return _mm_and_si128( left, right );
+    }
+#endif
+
+    static uint64_t apply( const uint64_t left, const uint64_t right )
+    {
+        return left & right;
+    }
+};
+
+// the bits of left which are not in right
+struct bitwise_and_not
+{
+#if PS_HAVE_AVX2
+    static __m256i apply( const __m256i left, const __m256i right )
+    {
+        return _mm256_andnot_si256( right, left );
+    }
+#elif PS_HAVE_SSE2
+    static __m128i apply( const __m128i left, const __m128i right )
+    {
+        return _mm_andnot_si128( right, left );
+    }
+#endif
+
+    static uint64_t apply( const uint64_t left, const uint64_t right )
+    {
+        return left & ~right;
+    }
+};
+
+// left[i] = Operation( left[i], right[i] ), 256 or 128 bits at a time where available
+template< typename Operation >
+static inline
+void apply_bitwise( uint64_t * const left, const uint64_t * const right, const std::size_t words )
+{
+    std::size_t i = 0;
+#if PS_HAVE_AVX2
+    for ( ; i + 4 <= words; i += 4 )
+    {
+        const __m256i a = _mm256_loadu_si256( reinterpret_cast< const __m256i * >( left + i ) );
+        const __m256i b = _mm256_loadu_si256( reinterpret_cast< const __m256i * >( right + i ) );
+        _mm256_storeu_si256( reinterpret_cast< __m256i * >( left + i ), Operation::apply( a, b ) );
+    }
+#elif PS_HAVE_SSE2
+    for ( ; i + 2 <= words; i += 2 )
+    {
+        const __m128i a = _mm_loadu_si128( reinterpret_cast< const __m128i * >( left + i ) );
+        const __m128i b = _mm_loadu_si128( reinterpret_cast< const __m128i * >( right + i ) );
+        _mm_storeu_si128( reinterpret_cast< __m128i * >( left + i ), Operation::apply( a, b ) );
+    }
+#endif
+
+    for ( ; i < words; ++i )
+        left[i] = Operation::apply( left[i], right[i] );
+}
+
+} // ns details
+
+/**@struct pid_set
+ * @brief A set of pids, stored as one bit per possible pid
+ *
+ * The set is sized from the pid limit of the kernel, 512 KiB for the largest
+ * linux accepts, so that inserting, erasing and testing a pid are a single
+ * bit operation. Unions, intersections and differences walk both bitmaps
+ * 256 bits at a time when compiled for AVX2, or 128 bits with SSE2.
+ *
+ * Pids above the limit, which only appear if it is raised after the set was
+ * built, grow the set. */
+struct pid_set
+{
+    /**@struct const_iterator
+     * @brief Walks the pids of a set, in ascending order */
+    struct const_iterator
+    {
+        typedef std::forward_iterator_tag iterator_category;
+        typedef pid_t                     value_type;
+        typedef std::ptrdiff_t            difference_type;
+        typedef const pid_t *             pointer;
+        typedef pid_t                     reference;
+
+        const_iterator( const pid_set & set, const std::size_t bit )
+            : m_set( &set )
+            , m_bit( set.next( bit ) )
+        {
+        }
+
+        pid_t operator*() const
+        {
+            return static_cast< pid_t >( m_bit );
+        }
+
+        const_iterator & operator++()
+        {
+            m_bit = m_set->next( m_bit + 1 );
+            return *this;
+        }
+
+        const_iterator operator++( int )
+        {
+            const_iterator previous( *this );
+            ++*this;
+            return previous;
+        }
+
+        bool operator==( const const_iterator & other ) const
+        {
+            return m_bit == other.m_bit;
+        }
+
+        bool operator!=( const const_iterator & other ) const
+        {
+            return m_bit != other.m_bit;
+        }
+
+    private:
+        const pid_set * m_set;
+        std::size_t     m_bit;
+    };
+
+    /**@brief Creates an empty set, sized from the pid limit of the kernel */
+    pid_set()
+    {
+        reserve( default_capacity() );
+    }
+
+    /**@brief Creates an empty set
+     * @param[in] pid_max The pids the set holds without growing are below this value */
+    explicit
+    pid_set( const std::size_t pid_max )
+    {
+        reserve( pid_max );
+    }
+
+    /**@brief Creates the set of the pids of a snapshot */
+    explicit
+    pid_set( const snapshot & processes )
+    {
+        reserve( default_capacity() );
+        for ( const process & p : processes )
+            insert( p.pid() );
+    }
+
+    /**@brief Returns the number of pids the set holds without growing */
+    std::size_t capacity() const
+    {
+        return m_words.size() * 64;
+    }
+
+    /**@brief Adds a pid
+     * @return false if the pid was in the set already, or is negative */
+    bool insert( const pid_t pid )
+    {
+        if ( pid < 0 )
+            return false;
+
+        if ( static_cast< std::size_t >( pid ) >= capacity() )
+            reserve( static_cast< std::size_t >( pid ) + 1 );
+
+        uint64_t & word = m_words[pid / 64];
+        const uint64_t mask = 1ULL << ( pid % 64 );
+        const bool inserted = !( word & mask );
+        word |= mask;
+        return inserted;
+    }
+
+    /**@brief Removes a pid
+     * @return false if the pid was not in the set */
+    bool erase( const pid_t pid )
+    {
+        if ( !contains( pid ) )
+            return false;
+
+        m_words[pid / 64] &= ~( 1ULL << ( pid % 64 ) );
+        return true;
+    }
+
+    bool contains( const pid_t pid ) const
+    {
+        return pid >= 0 && static_cast< std::size_t >( pid ) < capacity() &&
+               ( m_words[pid / 64] >> ( pid % 64 ) ) & 1;
+    }
+
+    /**@brief Returns the number of pids in the set */
+    std::size_t count() const
+    {
+        std::size_t total = 0;
+        for ( const uint64_t word : m_words )
+            total += details::popcount( word );
+
+        return total;
+    }
+
+    bool empty() const
+    {
+        return std::find_if( m_words.begin(), m_words.end(),
+                             []( const uint64_t word ) { return word != 0; } ) == m_words.end();
+    }
+
+    void clear()
+    {
+        std::fill( m_words.begin(), m_words.end(), 0 );
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator( *this, 0 );
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator( *this, capacity() );
+    }
+
+    /**@brief Adds the pids of another set */
+    pid_set & operator|=( const pid_set & other )
+    {
+        if ( other.m_words.size() > m_words.size() )
+            m_words.resize( other.m_words.size(), 0 );
+
+        details::apply_bitwise< details::bitwise_or >( m_words.data(), other.m_words.data(),
+                                                       other.m_words.size() );
+        return *this;
+    }
+
+    /**@brief Keeps the pids which are also in another set */
+    pid_set & operator&=( const pid_set & other )
+    {
+        const std::size_t common = std::min( m_words.size(), other.m_words.size() );
+        details::apply_bitwise< details::bitwise_and >( m_words.data(), other.m_words.data(), common );
+        std::fill( m_words.begin() + common, m_words.end(), 0 );
+        return *this;
+    }
+
+    /**@brief Removes the pids of another set */
+    pid_set & operator-=( const pid_set & other )
+    {
+        const std::size_t common = std::min( m_words.size(), other.m_words.size() );
+        details::apply_bitwise< details::bitwise_and_not >( m_words.data(), other.m_words.data(), common );
+        return *this;
+    }
+
+    bool operator==( const pid_set & other ) const
+    {
+        const std::size_t common = std::min( m_words.size(), other.m_words.size() );
+        const std::vector< uint64_t > & longer = m_words.size() > common ? m_words : other.m_words;
+
+        return std::equal( m_words.begin(), m_words.begin() + common, other.m_words.begin() ) &&
+               std::find_if( longer.begin() + common, longer.end(),
+                             []( const uint64_t word ) { return word != 0; } ) == longer.end();
+    }
+
+    bool operator!=( const pid_set & other ) const
+    {
+        return !( *this == other );
+    }
+
+    /**@brief Returns the pids of the set, in ascending order */
+    std::vector< pid_t > to_vector() const
+    {
+        std::vector< pid_t > pids;
+        pids.reserve( count() );
+        pids.assign( begin(), end() );
+        return pids;
+    }
+
+    /**@brief Returns the processes of a snapshot whose pid is in the set
+     * @param[in] processes The processes to filter, whose order is kept */
+    snapshot select( const snapshot & processes ) const
+    {
+        snapshot selected;
+        for ( const process & p : processes )
+        {
+            if ( contains( p.pid() ) )
+                selected.push_back( p );
+        }
+
+        return selected;
+    }
+
+    /**@brief Reads the processes of the set
+     * @param[in] wanted The attributes to read, the others are left empty */
+    snapshot to_snapshot( const fields wanted = FIELD_PID ) const
+    {
+        snapshot processes;
+        processes.reserve( count() );
+        for ( const pid_t pid : *this )
+            processes.emplace_back( pid, wanted );
+
+        return processes;
+    }
+
+private:
+    static std::size_t default_capacity()
+    {
+        const std::size_t pid_max = get_pid_max();
+        return pid_max ? pid_max : details::PID_MAX_LIMIT;
+    }
+
+    // grows the bitmap to hold every pid below pid_max
+    void reserve( const std::size_t pid_max )
+    {
+        const std::size_t words = ( pid_max + 63 ) / 64;
+        if ( words > m_words.size() )
+            m_words.resize( words, 0 );
+    }
+
+    // returns the first pid of the set at or after bit, or capacity()
+    std::size_t next( const std::size_t bit ) const
+    {
+        std::size_t index = bit / 64;
+        if ( index >= m_words.size() )
+            return capacity();
+
+        uint64_t word = m_words[index] & ( ~0ULL << ( bit % 64 ) );
+        while ( word == 0 )
+        {
+            if ( ++index == m_words.size() )
+                return capacity();
+
+            word = m_words[index];
+        }
+
+        return index * 64 + details::lowest_bit( word );
+    }
+
+    std::vector< uint64_t > m_words;
+};
+
+inline
+pid_set operator|( pid_set left, const pid_set & right )
+{
+    left |= right;
+    return left;
+}
+
+inline
+pid_set operator&( pid_set left, const pid_set & right )
+{
+    left &= right;
+    return left;
+}
+
+/**@brief Returns the pids of left which are not in right */
+inline
+pid_set operator-( pid_set left, const pid_set & right )
+{
+    left -= right;
+    return left;
+}
+
+} // namespace ps
+
+#endif // PS_PID_SET_H
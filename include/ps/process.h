@@ -8,6 +8,8 @@
 #include "ps/common.h"
 #include "ps/icon.h"
 #include "ps/cocoa.h"
+#include "ps/procfs.h"
+#include "ps/string_pool.h"
 
 namespace ps
 {
@@ -88,30 +90,136 @@ bool is_cmdline_valid( const std::string & cmdline )
     return true;
 }
 
+// the strings describing a process. Copies of a process share them, so they
+// are copied before being modified if they are shared
+struct process_attributes
+{
+    shared_string cmdline;
+    shared_string title;
+    shared_string name;
+    shared_string version;
+
+    ///< Used on mac to store the path to the icon
+    std::string   icon;
+};
+
+// what /proc tells about a process besides its strings, shared between copies
+// as the attributes are. The start time of a process is that of its stat
+struct process_counters
+{
+    process_stat   stat;
+    process_memory memory;
+    process_io     io;
+};
+
+static inline
+const process_counters & empty_counters()
+{
+    static const process_counters empty;
+    return empty;
+}
+
+static inline
+const std::string & empty_string()
+{
+    static const std::string empty;
+    return empty;
+}
+
+// a process which exited but was not reaped by its parent yet still answers kill()
+static inline
+bool is_zombie( const pid_t pid )
+{
+#if PS_HAVE_PROCFS
+    process_stat stat;
+    return read_process_stat( pid, stat ) && ( stat.state == 'Z' || stat.state == 'X' );
+#else
+    ( void )pid;
+    return false;
+#endif
+}
+
 } // ns details
 
+/**@brief The attributes of a process which are read when it is captured
+ *
+ * Attributes which are not asked for are left empty, and the files or
+ * system calls they come from are not touched at all. */
+enum fields
+{
+    FIELD_PID        = 0x0,  ///< nothing but the pid, which is always known
+    FIELD_CMDLINE    = 0x1,  ///< see process::cmdline()
+    FIELD_NAME       = 0x2,  ///< see process::name()
+    FIELD_TITLE      = 0x4,  ///< see process::title()
+    FIELD_VERSION    = 0x8,  ///< see process::version()
+    FIELD_ICON       = 0x10, ///< the path to the icon, on mac
+    FIELD_STAT       = 0x20, ///< what /proc/<pid>/stat tells, see process::start_time() and process::stat()
+    FIELD_ALL        = 0x3f, ///< every attribute above
+#if PS_HAVE_PROCFS
+    /// what is read when no attributes are given, as before they could be: the
+    /// command line, and the title from the window manager. FIELD_NAME and
+    /// FIELD_STAT cost one more file per process, so they have to be asked for
+    FIELD_DEFAULT    = 0x1d,
+#else
+    /// what is read when no attributes are given: the platform reads them together
+    FIELD_DEFAULT    = 0x1f,
+#endif
+
+    FIELD_MEMORY        = 0x40, ///< the memory from /proc/<pid>/statm, see process::memory()
+    FIELD_MEMORY_STATUS = 0x80, ///< the peaks and the swap from /proc/<pid>/status, implies FIELD_MEMORY
+    FIELD_IO            = 0x100 ///< the counters of /proc/<pid>/io, see process::io()
+};
+
+inline
+fields operator|( const fields left, const fields right )
+{
+    return static_cast< fields >( static_cast< unsigned >( left ) | static_cast< unsigned >( right ) );
+}
+
 /**@struct process
- * @brief describes a process */
+ * @brief describes a process
+ *
+ * Copies of a process share its strings, so copying a process or a snapshot
+ * costs a few reference counts per process. The accessors return references
+ * which are valid as long as the process they come from. */
 struct process
 {
     /**@brief Constructs a process from the given pid
      *
      * This constructor will automatically try and retrieve the data for
      * title, name, etc. from the pid
-     * @param[in] pid The process id given by the OS */
+     * @param[in] pid The process id given by the OS
+     * @param[in] wanted The attributes to retrieve, the others are left empty */
     explicit
-    process( pid_t pid );
+    process( pid_t pid, fields wanted = FIELD_DEFAULT );
 
     /**@brief Constructs a process, and manually assign all the information to it
      * @param[in] cmdline The absolute path to the binary executable
      * @param[in] title The title of the process. The most human-friendly one. Like "Skype".
      * @param[in] name The name of the process, as perceived by the OS. Could be something like Microsoft.Skype
-     * @param[in] version The version being run */
+     * @param[in] version The version being run
+     * @param[in] start_time When the process started, see start_time() */
     process( pid_t pid,
              const std::string & cmdline,
              const std::string & title   = "",
              const std::string & name    = "",
-             const std::string & version = "" );
+             const std::string & version = "",
+             unsigned long long start_time = 0 );
+
+#if HAVE_STD__MOVE
+    /**@brief Constructs a process, taking over a command line instead of copying it
+     * @param[in] cmdline The absolute path to the binary executable */
+    process( pid_t pid, std::string && cmdline );
+
+    /**@brief Constructs a process, taking over its attributes instead of copying them
+     *
+     * Unlike the constructor taking a title, the name comes third.
+     * @param[in] cmdline The absolute path to the binary executable
+     * @param[in] name The name of the process, as perceived by the OS
+     * @param[in] start_time When the process started, see start_time() */
+    process( pid_t pid, std::string && cmdline, std::string && name,
+             unsigned long long start_time );
+#endif
 
     /**@brief Creates an invalid process */
     process();
@@ -138,18 +246,18 @@ struct process
     /**@brief This is the name that makes most sense to a human
      *        It could be the title bar, or the product name as
      *        advertized by its creator */
-    std::string title() const;
+    const std::string & title() const;
 
     /**@brief Returns the command line used to run the binary executable */
-    std::string cmdline() const;
+    const std::string & cmdline() const;
 
     /**@brief Returns the name of the application as seen by the OS
      *
      * For instance, on linux it could be "gnu-tar" */
-    std::string name() const;
+    const std::string & name() const;
 
     /**@brief Returns the version of the application, if it was provided */
-    std::string version() const;
+    const std::string & version() const;
 
     /**@brief Returns the main icon of the process
      *
@@ -169,23 +277,157 @@ struct process
         return m_pid;
     }
 
+    /**@brief Returns when the process started, or 0 if it is unknown
+     *
+     * On linux, this is the number of clock ticks between boot and the start
+     * of the process. Together with the pid, it identifies a process even
+     * after its pid has been reused. */
+    unsigned long long start_time() const
+    {
+        return m_counters ? m_counters->stat.start_time : 0;
+    }
+
+    /**@brief Returns what /proc/<pid>/stat told when the process was captured
+     *
+     * Only read on linux, with FIELD_STAT. Otherwise, every field is 0. */
+    const process_stat & stat() const
+    {
+        return counters().stat;
+    }
+
+    /**@brief Replaces what /proc/<pid>/stat told about the process
+     *
+     * The start time is left alone, see reset() to change it. */
+    void set_stat( const process_stat & stat )
+    {
+        details::process_counters & counters = mutable_counters();
+        const unsigned long long start_time = counters.stat.start_time;
+        counters.stat = stat;
+        counters.stat.start_time = start_time;
+    }
+
+    /**@brief Returns how much memory the process used when it was captured
+     *
+     * Only read on linux, with FIELD_MEMORY or FIELD_MEMORY_STATUS.
+     * Otherwise, every field is 0. */
+    const process_memory & memory() const
+    {
+        return counters().memory;
+    }
+
+    /**@brief Replaces how much memory the process uses */
+    void set_memory( const process_memory & memory )
+    {
+        mutable_counters().memory = memory;
+    }
+
+    /**@brief Returns the I/O counters of the process when it was captured
+     *
+     * Only read on linux, with FIELD_IO, for the processes we may inspect.
+     * Otherwise, every field is 0. */
+    const process_io & io() const
+    {
+        return counters().io;
+    }
+
+    /**@brief Replaces the I/O counters of the process */
+    void set_io( const process_io & io )
+    {
+        mutable_counters().io = io;
+    }
+
     /**@brief Kills the process
+     *
+     * If the process was pinned with open_pidfd(), the signal cannot reach another
+     * process which would have reused the pid.
      * @param[in] softly When set to true, calling this method will only notify the process that it should terminate. Otherwise it will send a fatal signal
      * @return 0 on success, -1 if insufficient privileges, -2 if the process could not be found */
     int kill( bool softly ) const;
 
+    /**@brief Pins the process with a pidfd
+     *
+     * Afterwards, kill() and wait_exit() address this very process, even if its
+     * pid gets reused. Copies of this object share the same pidfd.
+     * Only available on linux 5.3 and later. The start time is checked
+     * against that of the process holding the pid, or read from it and kept
+     * if it was not captured.
+     * @return true if the process is pinned, false if it is gone or if its
+     *         start time shows that the pid now belongs to another process */
+    bool open_pidfd();
+
+    /**@brief Returns the pidfd opened by open_pidfd(), or -1 */
+    int pidfd() const;
+
+#if HAVE_CHRONO
+    /**@brief Waits for the process to exit
+     *
+     * Without a pidfd, the process is polled every few milliseconds. A zombie,
+     * which exited but was not reaped yet, counts as exited.
+     * @param[in] timeout How long to wait. A negative value waits forever
+     * @return true if the process exited, false if the timeout expired */
+    bool wait_exit( std::chrono::milliseconds timeout ) const;
+#endif
+
+    /**@brief Completes this description with another one of the same process
+     *
+     * Only the attributes which are empty here are taken from the other
+     * description, and they are moved rather than copied.
+     * @param[in] other Another description of the same pid, like the one of a window manager */
+    void merge( process other );
+
+    /**@brief Describes another process, or the same one again, reusing the storage of this object
+     *
+     * Strings which did not change are left alone, and the others are
+     * written over the previous ones, so that refreshing a process whose
+     * attributes are not shared with a copy does not allocate. The title,
+     * the version, stat(), memory() and io() are cleared. The pidfd is
+     * dropped unless pid and start time are unchanged.
+     * @param[in] cmdline The command line, see cmdline()
+     * @param[in] name The name of the process as perceived by the OS, see name()
+     * @param[in] start_time When the process started, see start_time() */
+    void reset( pid_t pid, boost::string_ref cmdline, boost::string_ref name,
+                unsigned long long start_time );
+
+    /**@brief Describes another process, taking its strings from a pool
+     *
+     * The strings already in the pool are shared rather than copied, so that
+     * they can be interned straight from the buffer they were read into.
+     * @see reset( pid_t, boost::string_ref, boost::string_ref, unsigned long long ) */
+    void reset( pid_t pid, boost::string_ref cmdline, boost::string_ref name,
+                unsigned long long start_time, string_pool & pool );
+
+    /**@brief Replaces the strings of this process with their copies from a pool
+     *
+     * Afterwards, the strings equal to those of other processes interned in
+     * the same pool share their storage with them. */
+    void intern( string_pool & pool );
+
 private:
     pid_t       m_pid;
-    std::string m_cmdline;
-    std::string m_title;
-    std::string m_name;
-    std::string m_version;
 
-    ///< Used on mac to store the path to the icon
-    std::string m_icon;
+    ///< Shared between copies, and never modified once shared. Null if every attribute is empty
+    std::shared_ptr< details::process_attributes > m_attributes;
+
+    ///< Shared between copies as m_attributes is. Null unless the start time, the stat,
+    ///< the memory or the I/O counters were read
+    std::shared_ptr< details::process_counters > m_counters;
+
+    ///< Shared between copies, closed along with the last one
+    std::shared_ptr< details::file_descriptor > m_pidfd;
 
 private:
     void improve_metro_name();
+
+    // returns attributes which only this object sees, copying them if they are shared
+    details::process_attributes & mutable_attributes();
+
+    const details::process_counters & counters() const
+    {
+        return m_counters ? *m_counters : details::empty_counters();
+    }
+
+    // returns counters which only this object sees, copying them if they are shared
+    details::process_counters & mutable_counters();
 };
 
 inline
@@ -193,25 +435,57 @@ process::process( pid_t pid,
                   const std::string & cmdline,
                   const std::string & title,
                   const std::string & name,
-                  const std::string & version )
+                  const std::string & version,
+                  const unsigned long long start_time )
+    : m_pid( pid )
+{
+    if ( start_time != 0 )
+        mutable_counters().stat.start_time = start_time;
+
+    if ( !cmdline.empty() || !title.empty() || !name.empty() || !version.empty() )
+    {
+        details::process_attributes & attributes = mutable_attributes();
+        attributes.cmdline = cmdline;
+        attributes.title   = title;
+        attributes.name    = name;
+        attributes.version = version;
+    }
+}
+
+#if HAVE_STD__MOVE
+inline
+process::process( pid_t pid, std::string && cmdline )
     : m_pid( pid )
-    , m_cmdline( cmdline )
-    , m_title( title )
-    , m_name( name )
-    , m_version( version )
-    , m_icon( "" )
 {
+    if ( !cmdline.empty() )
+        mutable_attributes().cmdline = std::move( cmdline );
 }
 
+inline
+process::process( pid_t pid, std::string && cmdline,
+                  std::string && name,
+                  const unsigned long long start_time )
+    : m_pid( pid )
+{
+    if ( start_time != 0 )
+        mutable_counters().stat.start_time = start_time;
+
+    if ( !cmdline.empty() || !name.empty() )
+    {
+        details::process_attributes & attributes = mutable_attributes();
+        attributes.cmdline = std::move( cmdline );
+        attributes.name    = std::move( name );
+    }
+}
+#endif
+
 inline
 process & process::operator=( const process & other )
 {
-    m_pid     = other.m_pid;
-    m_cmdline = other.m_cmdline;
-    m_title   = other.m_title;
-    m_name    = other.m_name;
-    m_version = other.m_version;
-    m_icon    = other.m_icon;
+    m_pid        = other.m_pid;
+    m_attributes = other.m_attributes;
+    m_counters   = other.m_counters;
+    m_pidfd      = other.m_pidfd;
 
     return *this;
 }
@@ -220,12 +494,10 @@ process & process::operator=( const process & other )
 inline
 process & process::operator=( process && other )
 {
-    m_pid     = std::move( other.m_pid );
-    m_cmdline = std::move( other.m_cmdline );
-    m_title   = std::move( other.m_title );
-    m_name    = std::move( other.m_name );
-    m_version = std::move( other.m_version );
-    m_icon    = std::move( other.m_icon );
+    m_pid        = other.m_pid;
+    m_attributes = std::move( other.m_attributes );
+    m_counters   = std::move( other.m_counters );
+    m_pidfd      = std::move( other.m_pidfd );
 
     return *this;
 }
@@ -233,12 +505,10 @@ process & process::operator=( process && other )
 
 inline
 process::process( const process & copy )
-    : m_pid(     copy.m_pid     )
-    , m_cmdline( copy.m_cmdline )
-    , m_title(   copy.m_title   )
-    , m_name(    copy.m_name    )
-    , m_version( copy.m_version )
-    , m_icon(    copy.m_icon    )
+    : m_pid(        copy.m_pid )
+    , m_attributes( copy.m_attributes )
+    , m_counters(   copy.m_counters )
+    , m_pidfd(      copy.m_pidfd )
 {
 }
 
@@ -246,37 +516,204 @@ process::process( const process & copy )
 #if HAVE_STD__MOVE
 inline
 process::process( process && copy )
-    : m_pid(        std::move( copy.m_pid ) )
-    , m_cmdline(    std::move( copy.m_cmdline ) )
-    , m_title(      std::move( copy.m_title ) )
-    , m_name(       std::move( copy.m_name ) )
-    , m_version(    std::move( copy.m_version ) )
-    , m_icon(       std::move( copy.m_icon ) )
+    : m_pid(        copy.m_pid )
+    , m_attributes( std::move( copy.m_attributes ) )
+    , m_counters(   std::move( copy.m_counters ) )
+    , m_pidfd(      std::move( copy.m_pidfd ) )
 {
 }
 #endif
 
+inline
+details::process_attributes & process::mutable_attributes()
+{
+    if ( !m_attributes )
+        m_attributes = std::make_shared< details::process_attributes >();
+    else if ( m_attributes.use_count() > 1 )
+        m_attributes = std::make_shared< details::process_attributes >( *m_attributes );
+
+    return *m_attributes;
+}
+
+inline
+details::process_counters & process::mutable_counters()
+{
+    if ( !m_counters )
+        m_counters = std::make_shared< details::process_counters >();
+    else if ( m_counters.use_count() > 1 )
+        m_counters = std::make_shared< details::process_counters >( *m_counters );
+
+    return *m_counters;
+}
+
+inline
+void process::merge( process other )
+{
+    assert( other.m_pid == m_pid );
+
+    if ( !m_pidfd )
+        m_pidfd.swap( other.m_pidfd );
+
+    if ( !m_counters )
+        m_counters.swap( other.m_counters );
+    else if ( other.m_counters )
+    {
+        const details::process_counters & mine = *m_counters;
+        const details::process_counters & theirs = *other.m_counters;
+        const bool completes =
+               ( mine.stat.start_time == 0 && theirs.stat.start_time != 0 )
+            || ( mine.stat.state == 0 && theirs.stat.state != 0 )
+            || ( mine.memory.size == 0 && theirs.memory.size != 0 )
+            || ( mine.io.rchar == 0 && mine.io.wchar == 0 && ( theirs.io.rchar != 0 || theirs.io.wchar != 0 ) );
+
+        // leave the counters shared if there is nothing to take
+        if ( completes )
+        {
+            details::process_counters & counters = mutable_counters();
+            const unsigned long long start_time = counters.stat.start_time;
+            if ( counters.stat.state == 0 )
+                counters.stat = theirs.stat;
+            counters.stat.start_time = start_time ? start_time : theirs.stat.start_time;
+            if ( counters.memory.size == 0 )
+                counters.memory = theirs.memory;
+            if ( counters.io.rchar == 0 && counters.io.wchar == 0 )
+                counters.io = theirs.io;
+        }
+    }
+
+    if ( !other.m_attributes )
+        return;
+
+    if ( !m_attributes )
+    {
+        m_attributes.swap( other.m_attributes );
+        return;
+    }
+
+    const details::process_attributes & mine = *m_attributes;
+    const details::process_attributes & theirs = *other.m_attributes;
+    const bool completes =
+           ( mine.cmdline.empty() && !theirs.cmdline.empty() )
+        || ( mine.title.empty()   && !theirs.title.empty() )
+        || ( mine.name.empty()    && !theirs.name.empty() )
+        || ( mine.version.empty() && !theirs.version.empty() )
+        || ( mine.icon.empty()    && !theirs.icon.empty() );
+
+    // leave the attributes shared if there is nothing to take
+    if ( !completes )
+        return;
+
+    details::process_attributes & attributes = mutable_attributes();
+    details::process_attributes & other_attributes = other.mutable_attributes();
+    if ( attributes.cmdline.empty() )
+        attributes.cmdline.swap( other_attributes.cmdline );
+    if ( attributes.title.empty() )
+        attributes.title.swap( other_attributes.title );
+    if ( attributes.name.empty() )
+        attributes.name.swap( other_attributes.name );
+    if ( attributes.version.empty() )
+        attributes.version.swap( other_attributes.version );
+    if ( attributes.icon.empty() )
+        attributes.icon.swap( other_attributes.icon );
+}
+
+inline
+void process::reset( const pid_t pid, const boost::string_ref cmdline,
+                     const boost::string_ref name, const unsigned long long start_time )
+{
+    // the pidfd would address the process which had this pid before
+    if ( pid != m_pid || start_time != this->start_time() )
+        m_pidfd.reset();
+
+    m_pid = pid;
+
+    // counters which only this object sees are written over, the others are dropped
+    if ( m_counters && m_counters.use_count() == 1 )
+        *m_counters = details::process_counters();
+    else
+        m_counters.reset();
+
+    if ( start_time != 0 )
+        mutable_counters().stat.start_time = start_time;
+
+    if ( !m_attributes )
+    {
+        if ( cmdline.empty() && name.empty() )
+            return;
+    }
+    else
+    {
+        const details::process_attributes & current = *m_attributes;
+        if ( cmdline == boost::string_ref( current.cmdline.str() ) &&
+             name == boost::string_ref( current.name.str() ) &&
+             current.title.empty() && current.version.empty() && current.icon.empty() )
+            return;
+    }
+
+    details::process_attributes & attributes = mutable_attributes();
+    attributes.cmdline.assign( cmdline );
+    attributes.name.assign( name );
+    attributes.title.assign( boost::string_ref() );
+    attributes.version.assign( boost::string_ref() );
+    attributes.icon.clear();
+}
+
+inline
+void process::reset( const pid_t pid, const boost::string_ref cmdline,
+                     const boost::string_ref name, const unsigned long long start_time,
+                     string_pool & pool )
+{
+    reset( pid, boost::string_ref(), boost::string_ref(), start_time );
+    if ( cmdline.empty() && name.empty() )
+        return;
+
+    details::process_attributes & attributes = mutable_attributes();
+    attributes.cmdline = pool.intern( cmdline );
+    attributes.name    = pool.intern( name );
+}
+
+inline
+void process::intern( string_pool & pool )
+{
+    if ( !m_attributes )
+        return;
+
+    details::process_attributes & attributes = mutable_attributes();
+    attributes.cmdline = pool.intern( attributes.cmdline );
+    attributes.title   = pool.intern( attributes.title );
+    attributes.name    = pool.intern( attributes.name );
+    attributes.version = pool.intern( attributes.version );
+}
+
 std::string get_cmdline_from_pid( pid_t );
 inline
-process::process( const pid_t pid )
+process::process( const pid_t pid, const fields wanted )
     : m_pid( pid )
-    , m_cmdline( get_cmdline_from_pid( pid ) )
-    , m_title( "" )
-    , m_name( "" )
-    , m_version( "" )
-    , m_icon( "" )
 {
     using namespace ps::details;
+    if ( wanted & FIELD_CMDLINE )
+    {
+        std::string cmdline = get_cmdline_from_pid( pid );
+        if ( !cmdline.empty() )
+            mutable_attributes().cmdline = PS_MOVE( cmdline );
+    }
+
 #if HAVE_WINVER_H
-    if ( m_cmdline.empty() )
+    if ( !( wanted & ( FIELD_NAME | FIELD_TITLE | FIELD_VERSION ) ) )
+        return;
+
+    // the version information is stored in the executable itself
+    const std::string image =
+        ( wanted & FIELD_CMDLINE ) ? cmdline() : get_cmdline_from_pid( pid );
+    if ( image.empty() )
         return;
 
-    unsigned size = GetFileVersionInfoSize( m_cmdline.c_str(), 0 );
+    unsigned size = GetFileVersionInfoSize( image.c_str(), 0 );
     if ( !size )
         return;
 
     unique_ptr< unsigned char[] > data( new unsigned char[size] );
-    if ( !GetFileVersionInfo( m_cmdline.c_str(), 0, size, data.get() ) )
+    if ( !GetFileVersionInfo( image.c_str(), 0, size, data.get() ) )
         return;
 
     struct LANGANDCODEPAGE
@@ -298,11 +735,18 @@ process::process( const pid_t pid )
     std::string version   = details::get_specific_file_info( data.get(),
                             translate[0].language, translate[0].codepage, "ProductVersion" );
 
-    m_name.swap( name );
-    m_title.swap( title );
-    m_version.swap( version );
+    process_attributes & attributes = mutable_attributes();
+    if ( wanted & FIELD_NAME )
+        attributes.name = PS_MOVE( name );
+    if ( wanted & FIELD_TITLE )
+        attributes.title = PS_MOVE( title );
+    if ( wanted & FIELD_VERSION )
+        attributes.version = PS_MOVE( version );
 
 #elif HAVE_APPKIT_NSRUNNINGAPPLICATION_H && HAVE_APPKIT_NSWORKSPACE_H && HAVE_FOUNDATION_FOUNDATION_H
+    if ( !( wanted & ( FIELD_NAME | FIELD_TITLE | FIELD_VERSION | FIELD_ICON ) ) )
+        return;
+
     char * title,
          * name,
          * version,
@@ -327,60 +771,80 @@ process::process( const pid_t pid )
     unique_ptr< char, void ( * )( void * ) > icon_ptr   ( icon, &std::free );
     unique_ptr< char, void ( * )( void * ) > path_ptr   ( path, &std::free );
 
-    m_name.assign( name );
-    m_title.assign( title );
-    m_version.assign( version );
+    process_attributes & attributes = mutable_attributes();
+    if ( wanted & FIELD_NAME )
+        attributes.name = name;
+    if ( wanted & FIELD_TITLE )
+        attributes.title = title;
+    if ( wanted & FIELD_VERSION )
+        attributes.version = version;
 
     std::string bundle_path ( path ),
         icon_name   ( icon );
 
-    if ( !bundle_path.empty() && !icon_name.empty() )
-        m_icon.assign(
+    if ( ( wanted & FIELD_ICON ) && !bundle_path.empty() && !icon_name.empty() )
+        attributes.icon.assign(
             get_icon_path_from_icon_name( bundle_path,
                                           icon_name ) );
+#elif PS_HAVE_PROCFS
+    stat_identity identity;
+    process_stat stat;
+    if ( ( wanted & ( FIELD_NAME | FIELD_STAT ) ) && read_stat_identity( pid, identity, stat ) )
+    {
+        if ( wanted & FIELD_NAME )
+            mutable_attributes().name = PS_MOVE( identity.comm );
+        if ( wanted & FIELD_STAT )
+            mutable_counters().stat = stat;
+    }
+
+    if ( wanted & ( FIELD_MEMORY | FIELD_MEMORY_STATUS ) )
+        read_process_memory( pid, mutable_counters().memory, ( wanted & FIELD_MEMORY_STATUS ) != 0 );
+
+    if ( wanted & FIELD_IO )
+        read_process_io( pid, mutable_counters().io );
 #endif
 
-    if ( m_name == "WWAHost.exe" || m_name == "WWAHost" )
-        m_title = get_package_name( m_pid );
+    // name() asserts that the process is valid, which an invalid pid is not
+    if ( !( wanted & FIELD_TITLE ) || !valid() || !m_attributes )
+        return;
+
+    const std::string & name = m_attributes->name.str();
+    if ( name == "WWAHost.exe" || name == "WWAHost" )
+        mutable_attributes().title = get_package_name( m_pid );
 }
 
 inline
 process::process()
     : m_pid( INVALID_PID )
-    , m_cmdline( "" )
-    , m_title( "" )
-    , m_name( "" )
-    , m_version( "" )
-    , m_icon( "" )
 {
 }
 
 inline
 process::~process()
 {
-    //assert( !valid() || m_cmdline.empty() ||
-    //    boost::filesystem::exists( m_cmdline ) );
+    //assert( !valid() || cmdline().empty() ||
+    //    boost::filesystem::exists( cmdline() ) );
 }
 
 inline
-std::string process::cmdline() const
+const std::string & process::cmdline() const
 {
     assert( valid() );
-    return m_cmdline;
+    return m_attributes ? m_attributes->cmdline.str() : details::empty_string();
 }
 
 inline
-std::string process::title() const
+const std::string & process::title() const
 {
     assert( valid() );
-    return m_title;
+    return m_attributes ? m_attributes->title.str() : details::empty_string();
 }
 
 inline
-std::string process::name() const
+const std::string & process::name() const
 {
     assert( valid() );
-    return m_name;
+    return m_attributes ? m_attributes->name.str() : details::empty_string();
 }
 
 inline
@@ -391,8 +855,8 @@ std::vector< unsigned char > process::icon() const
 
     std::vector< unsigned char > icon_data = get_icon_from_pid( pid() );
 
-    if ( icon_data.empty() && !m_icon.empty() )
-        icon_data = ps::details::get_icon_from_file( m_icon );
+    if ( icon_data.empty() && m_attributes && !m_attributes->icon.empty() )
+        icon_data = ps::details::get_icon_from_file( m_attributes->icon );
 
     if ( icon_data.empty() && is_cmdline_valid( cmdline() ) )
         icon_data = ps::details::get_icon_from_file( cmdline() );
@@ -401,10 +865,10 @@ std::vector< unsigned char > process::icon() const
 }
 
 inline
-std::string process::version() const
+const std::string & process::version() const
 {
     assert( valid() );
-    return m_version;
+    return m_attributes ? m_attributes->version.str() : details::empty_string();
 }
 
 inline
@@ -419,12 +883,21 @@ int process::kill( const bool softly ) const
     using namespace ps::details;
     assert( valid() );
 #if HAVE_KILL
-    const int killed = ::kill( m_pid, softly ? SIGTERM : SIGKILL );
+    const int signal_number = softly ? SIGTERM : SIGKILL;
+
+#   if PS_HAVE_PIDFD
+    const int killed = m_pidfd
+        ? static_cast< int >( syscall( SYS_pidfd_send_signal, m_pidfd->get(),
+                                       signal_number, nullptr, 0 ) )
+        : ::kill( m_pid, signal_number );
+#   else
+    const int killed = ::kill( m_pid, signal_number );
+#   endif
 
-    if ( killed == EPERM )
+    if ( killed == -1 && errno == EPERM )
         return -1;
 
-    if ( killed == ESRCH )
+    if ( killed == -1 && errno == ESRCH )
         return -2;
 
     assert( killed == 0 );
@@ -441,6 +914,98 @@ int process::kill( const bool softly ) const
     return 0;
 }
 
+inline
+bool process::open_pidfd()
+{
+    using namespace ps::details;
+    assert( valid() );
+#if PS_HAVE_PIDFD
+    if ( m_pidfd )
+        return true;
+
+    std::shared_ptr< file_descriptor > pidfd = std::make_shared< file_descriptor >(
+        static_cast< int >( syscall( SYS_pidfd_open, m_pid, 0 ) ) );
+
+    if ( pidfd->get() < 0 )
+        return false;
+
+    // the pid may already belong to another process: compare start times. A
+    // process captured without its start time is identified by the one read
+    // now, so that it is never pinned on its pid alone
+    stat_identity identity;
+    if ( !read_stat_identity( m_pid, identity ) ||
+         ( start_time() != 0 && identity.start_time != start_time() ) )
+        return false;
+
+    // if the pinned process exited before stat was read, stat described another one
+    pollfd exited;
+    exited.fd = pidfd->get();
+    exited.events = POLLIN;
+    if ( poll( &exited, 1, 0 ) != 0 )
+        return false;
+
+    if ( start_time() == 0 )
+        mutable_counters().stat.start_time = identity.start_time;
+
+    m_pidfd.swap( pidfd );
+    return true;
+#else
+    return false;
+#endif
+}
+
+inline
+int process::pidfd() const
+{
+    return m_pidfd ? m_pidfd->get() : -1;
+}
+
+#if HAVE_CHRONO
+inline
+bool process::wait_exit( const std::chrono::milliseconds timeout ) const
+{
+    assert( valid() );
+#if PS_HAVE_PIDFD
+    if ( m_pidfd )
+    {
+        pollfd exited;
+        exited.fd = m_pidfd->get();
+        exited.events = POLLIN;
+
+        int ready;
+        do
+        {
+            // poll() takes an int, longer timeouts are cut short rather than wrapped
+            ready = poll( &exited, 1, timeout.count() < 0 ? -1 : static_cast< int >(
+                std::min< std::chrono::milliseconds::rep >( timeout.count(),
+                                                            std::numeric_limits< int >::max() ) ) );
+        }
+        while ( ready < 0 && errno == EINTR );
+
+        return ready > 0;
+    }
+#endif
+
+#if HAVE_KILL && HAVE_THREAD
+    typedef std::chrono::steady_clock clock;
+    const clock::time_point deadline = clock::now() + timeout;
+
+    while ( ( ::kill( m_pid, 0 ) == 0 || errno == EPERM ) && !details::is_zombie( m_pid ) )
+    {
+        if ( timeout.count() >= 0 && clock::now() >= deadline )
+            return false;
+
+        std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+    }
+
+    return true;
+#else
+    ( void )timeout;
+    return false;
+#endif
+}
+#endif
+
 inline
 void describe( std::ostream & ostr, const process & proc )
 {
@@ -0,0 +1,901 @@
+#ifndef PS_PROCFS_H
+#define PS_PROCFS_H
+
+#include "config.h"
+#include "ps/common.h"
+
+#if HAVE_FCNTL_H && HAVE_UNISTD_H && HAVE_DIRENT_H && defined( SYS_getdents64 )
+#   define PS_HAVE_PROCFS 1
+#else
+#   define PS_HAVE_PROCFS 0
+#endif
+
+#if HAVE_UNISTD_H && HAVE_POLL_H && defined( SYS_pidfd_open ) && defined( SYS_pidfd_send_signal )
+#   define PS_HAVE_PIDFD 1
+#else
+#   define PS_HAVE_PIDFD 0
+#endif
+
+namespace ps
+{
+
+/**@brief The default number of bytes kept from a file of /proc
+ *
+ * Longer contents, like the class path of some java programs, are truncated. */
+static PS_CONSTEXPR std::size_t PROCFS_READ_LIMIT = 128 * 1024;
+
+/**@struct process_stat
+ * @brief What /proc/<pid>/stat tells about a process
+ *
+ * Times are in clock ticks, see sysconf( _SC_CLK_TCK ). A state of 0 means
+ * that the file was not read. */
+struct process_stat
+{
+    process_stat()
+        : state( 0 )
+        , ppid( 0 )
+        , pgrp( 0 )
+        , session( 0 )
+        , utime( 0 )
+        , stime( 0 )
+        , start_time( 0 )
+        , threads( 0 )
+        , vsize( 0 )
+        , rss( 0 )
+    {
+    }
+
+    char               state;      ///< R running, S sleeping, D waiting on a disk, Z zombie, T stopped...
+    pid_t              ppid;       ///< the pid of the parent
+    pid_t              pgrp;       ///< the process group
+    pid_t              session;    ///< the session
+    unsigned long long utime;      ///< clock ticks spent in user mode
+    unsigned long long stime;      ///< clock ticks spent in kernel mode
+    unsigned long long start_time; ///< clock ticks between boot and the start of the process
+    unsigned long      threads;    ///< the number of threads
+    unsigned long long vsize;      ///< the size of the virtual memory, in bytes
+    unsigned long long rss;        ///< the resident set size, in pages
+};
+
+/**@struct process_memory
+ * @brief How much memory a process uses, in bytes
+ *
+ * The first fields come from /proc/<pid>/statm, which is cheap to read. The
+ * peaks and the swap come from /proc/<pid>/status, which costs a few times
+ * more, and are only read when asked for. Fields which were not read are 0. */
+struct process_memory
+{
+    process_memory()
+        : size( 0 )
+        , resident( 0 )
+        , shared( 0 )
+        , text( 0 )
+        , data( 0 )
+        , peak_size( 0 )
+        , peak_resident( 0 )
+        , swap( 0 )
+    {
+    }
+
+    unsigned long long size;          ///< the virtual memory, VmSize
+    unsigned long long resident;      ///< the resident set size, VmRSS
+    unsigned long long shared;        ///< the resident pages backed by a file or shared memory
+    unsigned long long text;          ///< the code
+    unsigned long long data;          ///< the data and the stack
+    unsigned long long peak_size;     ///< the largest virtual memory so far, VmPeak, from status
+    unsigned long long peak_resident; ///< the largest resident set size so far, VmHWM, from status
+    unsigned long long swap;          ///< the memory swapped out, VmSwap, from status
+};
+
+/**@struct process_io
+ * @brief The I/O counters of /proc/<pid>/io, since the process started
+ *
+ * Only the owner of a process, or root, may read them. Fields which were not
+ * read are 0. */
+struct process_io
+{
+    process_io()
+        : rchar( 0 )
+        , wchar( 0 )
+        , syscr( 0 )
+        , syscw( 0 )
+        , read_bytes( 0 )
+        , write_bytes( 0 )
+        , cancelled_write_bytes( 0 )
+    {
+    }
+
+    unsigned long long rchar;                 ///< the bytes read by read() and the like, cache hits included
+    unsigned long long wchar;                 ///< the bytes written by write() and the like
+    unsigned long long syscr;                 ///< the number of read syscalls
+    unsigned long long syscw;                 ///< the number of write syscalls
+    unsigned long long read_bytes;            ///< the bytes fetched from the storage
+    unsigned long long write_bytes;           ///< the bytes sent to the storage
+    unsigned long long cancelled_write_bytes; ///< the bytes of write_bytes which were truncated before reaching the storage
+};
+
+namespace details
+{
+
+// parses a directory name such as "12113" into a pid, without throwing
+// on names which are not processes, such as "dri" or "self"
+static inline
+bool parse_pid( const char * name, pid_t & pid )
+{
+    if ( *name == '\0' )
+        return false;
+
+    pid_t value = 0;
+    for ( ; *name != '\0'; ++name )
+    {
+        if ( *name < '0' || *name > '9' )
+            return false;
+
+        value = value * 10 + ( *name - '0' );
+    }
+
+    if ( value == INVALID_PID )
+        return false;
+
+    pid = value;
+    return true;
+}
+
+// the size of a path relative to /proc, such as "12113/cmdline"
+static PS_CONSTEXPR std::size_t PROCFS_PATH_SIZE = 64;
+
+// the size of the per-thread buffer which procfs files are read through
+static PS_CONSTEXPR std::size_t PROCFS_SCRATCH_SIZE = 4096;
+
+// returns a buffer private to the calling thread, so that reads never allocate
+static inline
+char * procfs_scratch_buffer()
+{
+    static thread_local char buffer[PROCFS_SCRATCH_SIZE];
+    return buffer;
+}
+
+#if PS_HAVE_PROCFS
+// returns a descriptor on /proc, opened once for the whole program, so that
+// the files of a process can be opened relatively to it without a path lookup
+static inline
+int procfs_dirfd()
+{
+    static const int fd = open( "/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+    return fd;
+}
+
+// writes "<pid>/<file_name>" into path, which is relative to procfs_dirfd()
+static inline
+void format_procfs_path( char ( &path )[PROCFS_PATH_SIZE],
+                         const pid_t pid, const char * const file_name )
+{
+    snprintf( path, PROCFS_PATH_SIZE, "%d/%s", static_cast< int >( pid ), file_name );
+}
+
+// appends what is left of the first line of fd to contents, until contents
+// holds max_size bytes. Only contents may allocate, and only if it has to grow.
+// String may be any string type, such as std::pmr::string
+template< typename String >
+static inline
+bool append_first_line( const int fd, String & contents,
+                        const std::size_t max_size )
+{
+    char * const scratch = procfs_scratch_buffer();
+
+    while ( contents.size() < max_size )
+    {
+        const std::size_t wanted =
+            std::min( PROCFS_SCRATCH_SIZE, max_size - contents.size() );
+
+        const ssize_t length = ::read( fd, scratch, wanted );
+        if ( length < 0 && errno == EINTR )
+            continue;
+
+        if ( length < 0 )
+            return false;
+
+        if ( length == 0 )
+            break;
+
+        const char * const end = scratch + length;
+        const char * const newline = std::find( static_cast< const char * >( scratch ), end, '\n' );
+        contents.append( static_cast< const char * >( scratch ), newline );
+
+        if ( newline != end )
+            break;
+    }
+
+    return true;
+}
+#endif
+
+// reads the first line of /proc/<pid>/<file_name>, without walking /proc,
+// and keeps at most max_size bytes of it
+template< typename String >
+static inline
+bool read_procfs_file( const pid_t pid, const char * const file_name,
+                       String & contents,
+                       const std::size_t max_size = PROCFS_READ_LIMIT )
+{
+#if PS_HAVE_PROCFS
+    if ( pid == INVALID_PID )
+        return false;
+
+    char path[PROCFS_PATH_SIZE];
+    format_procfs_path( path, pid, file_name );
+
+    // fails if the process is gone, or if we do not have the rights to read it
+    const int fd = openat( procfs_dirfd(), path, O_RDONLY | O_CLOEXEC );
+    if ( fd == -1 )
+        return false;
+
+    contents.clear();
+    const bool success = append_first_line( fd, contents, max_size );
+    close( fd );
+
+    return success;
+#else
+    ( void )pid;
+    ( void )file_name;
+    ( void )contents;
+    ( void )max_size;
+    return false;
+#endif
+}
+
+// reads the whole of /proc/<pid>/<file_name> into the scratch buffer of
+// the calling thread. Meant for small files such as stat: longer contents
+// are truncated to PROCFS_SCRATCH_SIZE bytes. error, if given, is set to the
+// errno of the syscall which failed, or to 0
+static inline
+bool read_procfs_scratch( const pid_t pid, const char * const file_name,
+                          std::size_t & length, int * const error = nullptr )
+{
+    const auto fail = [error]( const int value )
+    {
+        if ( error )
+            *error = value;
+        return false;
+    };
+
+#if PS_HAVE_PROCFS
+    if ( pid == INVALID_PID )
+        return fail( ESRCH );
+
+    char path[PROCFS_PATH_SIZE];
+    format_procfs_path( path, pid, file_name );
+
+    const int fd = openat( procfs_dirfd(), path, O_RDONLY | O_CLOEXEC );
+    if ( fd == -1 )
+        return fail( errno );
+
+    char * const scratch = procfs_scratch_buffer();
+    ssize_t read_bytes;
+    do
+    {
+        read_bytes = ::read( fd, scratch, PROCFS_SCRATCH_SIZE );
+    }
+    while ( read_bytes < 0 && errno == EINTR );
+
+    // close() could overwrite the errno of read()
+    const int read_error = errno;
+    close( fd );
+
+    if ( read_bytes < 0 )
+        return fail( read_error );
+
+    length = static_cast< std::size_t >( read_bytes );
+    if ( error )
+        *error = 0;
+
+    return true;
+#else
+    ( void )pid;
+    ( void )file_name;
+    ( void )length;
+    return fail( ENOSYS );
+#endif
+}
+
+// the fields of /proc/<pid>/stat which tell a process apart from a later
+// process reusing the same pid. String may be any string type, such as std::pmr::string
+template< typename String >
+struct basic_stat_identity
+{
+    explicit
+    basic_stat_identity( const typename String::allocator_type & allocator
+                             = typename String::allocator_type() )
+        : comm( allocator )
+        , start_time( 0 )
+    {
+    }
+
+    String             comm;       ///< the name of the executable, 15 characters but for kernel threads
+    unsigned long long start_time; ///< clock ticks between boot and the start of the process
+};
+
+typedef basic_stat_identity< std::string > stat_identity;
+
+// extracts comm and starttime (the 2nd and 22nd fields) from the contents of
+// /proc/<pid>/stat. comm is the only field which may contain spaces or
+// parentheses, so it is delimited by the first '(' and the *last* ')'
+static inline
+bool find_stat_comm( const char * const data, const char * const end,
+                     const char * & comm_begin, const char * & comm_end )
+{
+    comm_begin = std::find( data, end, '(' );
+    if ( comm_begin == end )
+        return false;
+
+    comm_end = end;
+    while ( comm_end != comm_begin && *--comm_end != ')' )
+        ;
+
+    return comm_end != comm_begin;
+}
+
+template< typename String >
+static inline
+bool parse_stat_identity( const char * const data, const std::size_t length,
+                          basic_stat_identity< String > & identity )
+{
+    const char * const end = data + length;
+    const char * comm_begin;
+    const char * comm_end;
+    if ( !find_stat_comm( data, end, comm_begin, comm_end ) )
+        return false;
+
+    const char * position = comm_end + 1;
+    for ( unsigned field = 3; field < 22; ++field )
+    {
+        while ( position != end && *position == ' ' )
+            ++position;
+        while ( position != end && *position != ' ' )
+            ++position;
+    }
+
+    while ( position != end && *position == ' ' )
+        ++position;
+
+    if ( position == end || *position < '0' || *position > '9' )
+        return false;
+
+    unsigned long long start_time = 0;
+    for ( ; position != end && *position >= '0' && *position <= '9'; ++position )
+        start_time = start_time * 10 + ( *position - '0' );
+
+    identity.comm.assign( comm_begin + 1, comm_end );
+    identity.start_time = start_time;
+    return true;
+}
+
+// reads comm and starttime from /proc/<pid>/stat
+template< typename String >
+static inline
+bool read_stat_identity( const pid_t pid, basic_stat_identity< String > & identity )
+{
+    std::size_t length;
+    if ( !read_procfs_scratch( pid, "stat", length ) )
+        return false;
+
+    return parse_stat_identity( procfs_scratch_buffer(), length, identity );
+}
+
+// the last field of /proc/<pid>/stat read by parse_process_stat(), rss
+static PS_CONSTEXPR unsigned STAT_LAST_FIELD = 24;
+
+// parses the fields of /proc/<pid>/stat which process_stat holds, without
+// allocating. The fields after comm are numbers, but for the state, so they
+// are all read as numbers, and only those of interest are kept
+static inline
+bool parse_process_stat( const char * const data, const std::size_t length, process_stat & stat )
+{
+    const char * const end = data + length;
+    const char * comm_begin;
+    const char * comm_end;
+    if ( !find_stat_comm( data, end, comm_begin, comm_end ) )
+        return false;
+
+    const char * position = comm_end + 1;
+    while ( position != end && *position == ' ' )
+        ++position;
+
+    if ( position == end )
+        return false;
+
+    const char state = *position++;
+
+    // indexed by field number, as in proc(5)
+    unsigned long long fields[STAT_LAST_FIELD + 1];
+    for ( unsigned field = 4; field <= STAT_LAST_FIELD; ++field )
+    {
+        while ( position != end && *position == ' ' )
+            ++position;
+
+        // tpgid, priority and nice may be negative, they are not kept
+        if ( position != end && *position == '-' )
+            ++position;
+
+        if ( position == end || *position < '0' || *position > '9' )
+            return false;
+
+        unsigned long long value = 0;
+        for ( ; position != end && *position >= '0' && *position <= '9'; ++position )
+            value = value * 10 + ( *position - '0' );
+
+        fields[field] = value;
+    }
+
+    stat.state      = state;
+    stat.ppid       = static_cast< pid_t >( fields[4] );
+    stat.pgrp       = static_cast< pid_t >( fields[5] );
+    stat.session    = static_cast< pid_t >( fields[6] );
+    stat.utime      = fields[14];
+    stat.stime      = fields[15];
+    stat.threads    = static_cast< unsigned long >( fields[20] );
+    stat.start_time = fields[22];
+    stat.vsize      = fields[23];
+    stat.rss        = fields[24];
+    return true;
+}
+
+// reads /proc/<pid>/stat into a process_stat
+static inline
+bool read_process_stat( const pid_t pid, process_stat & stat )
+{
+    std::size_t length;
+    if ( !read_procfs_scratch( pid, "stat", length ) )
+        return false;
+
+    return parse_process_stat( procfs_scratch_buffer(), length, stat );
+}
+
+// reads comm, and every field of process_stat, from a single read of /proc/<pid>/stat
+template< typename String >
+static inline
+bool read_stat_identity( const pid_t pid, basic_stat_identity< String > & identity,
+                         process_stat & stat )
+{
+    std::size_t length;
+    if ( !read_procfs_scratch( pid, "stat", length ) )
+        return false;
+
+    return parse_stat_identity( procfs_scratch_buffer(), length, identity )
+        && parse_process_stat( procfs_scratch_buffer(), length, stat );
+}
+
+static inline
+unsigned long long page_size()
+{
+#if HAVE_UNISTD_H
+    static const unsigned long long size = static_cast< unsigned long long >( sysconf( _SC_PAGESIZE ) );
+    return size;
+#else
+    return 4096;
+#endif
+}
+
+// parses "size resident shared text lib data dt", counted in pages
+static inline
+bool parse_statm( const char * const data, const std::size_t length, process_memory & memory )
+{
+    const char * const end = data + length;
+    const char * position = data;
+
+    unsigned long long fields[6];
+    for ( unsigned long long & field : fields )
+    {
+        while ( position != end && *position == ' ' )
+            ++position;
+
+        if ( position == end || *position < '0' || *position > '9' )
+            return false;
+
+        field = 0;
+        for ( ; position != end && *position >= '0' && *position <= '9'; ++position )
+            field = field * 10 + ( *position - '0' );
+    }
+
+    const unsigned long long page = page_size();
+    memory.size     = fields[0] * page;
+    memory.resident = fields[1] * page;
+    memory.shared   = fields[2] * page;
+    memory.text     = fields[3] * page;
+    memory.data     = fields[5] * page;
+    return true;
+}
+
+// parses the "VmPeak:   1234 kB" lines of /proc/<pid>/status. Kernel
+// threads have none of them, which leaves the fields at 0
+static inline
+bool parse_status_memory( const char * const data, const std::size_t length, process_memory & memory )
+{
+    const char * const end = data + length;
+    memory.peak_size = memory.peak_resident = memory.swap = 0;
+
+    for ( const char * line = data; line < end; )
+    {
+        const char * const line_end = std::find( line, end, '\n' );
+        unsigned long long * field = nullptr;
+
+        if ( line_end - line > 7 && memcmp( line, "Vm", 2 ) == 0 )
+        {
+            if ( memcmp( line + 2, "Peak:", 5 ) == 0 )
+                field = &memory.peak_size;
+            else if ( memcmp( line + 2, "HWM:", 4 ) == 0 )
+                field = &memory.peak_resident;
+            else if ( memcmp( line + 2, "Swap:", 5 ) == 0 )
+                field = &memory.swap;
+        }
+
+        if ( field )
+        {
+            const char * position = std::find( line, line_end, ':' ) + 1;
+            while ( position != line_end && ( *position == ' ' || *position == '\t' ) )
+                ++position;
+
+            unsigned long long kilobytes = 0;
+            for ( ; position != line_end && *position >= '0' && *position <= '9'; ++position )
+                kilobytes = kilobytes * 10 + ( *position - '0' );
+
+            *field = kilobytes * 1024;
+        }
+
+        line = line_end + 1;
+    }
+
+    return true;
+}
+
+// reads the memory of a process from statm, and from status if asked to
+static inline
+bool read_process_memory( const pid_t pid, process_memory & memory, const bool read_status )
+{
+    std::size_t length;
+    if ( !read_procfs_scratch( pid, "statm", length ) ||
+         !parse_statm( procfs_scratch_buffer(), length, memory ) )
+        return false;
+
+    if ( !read_status )
+        return true;
+
+    return read_procfs_scratch( pid, "status", length )
+        && parse_status_memory( procfs_scratch_buffer(), length, memory );
+}
+
+// parses the "rchar: 323934931" lines of /proc/<pid>/io
+static inline
+bool parse_process_io( const char * const data, const std::size_t length, process_io & io )
+{
+    const char * const end = data + length;
+    io = process_io();
+
+    std::size_t parsed = 0;
+    for ( const char * line = data; line < end; )
+    {
+        const char * const line_end = std::find( line, end, '\n' );
+        const char * const colon = std::find( line, line_end, ':' );
+
+        unsigned long long * field = nullptr;
+        const std::size_t key = colon - line;
+        if ( key == 5 && memcmp( line, "rchar", 5 ) == 0 )
+            field = &io.rchar;
+        else if ( key == 5 && memcmp( line, "wchar", 5 ) == 0 )
+            field = &io.wchar;
+        else if ( key == 5 && memcmp( line, "syscr", 5 ) == 0 )
+            field = &io.syscr;
+        else if ( key == 5 && memcmp( line, "syscw", 5 ) == 0 )
+            field = &io.syscw;
+        else if ( key == 10 && memcmp( line, "read_bytes", 10 ) == 0 )
+            field = &io.read_bytes;
+        else if ( key == 11 && memcmp( line, "write_bytes", 11 ) == 0 )
+            field = &io.write_bytes;
+        else if ( key == 21 && memcmp( line, "cancelled_write_bytes", 21 ) == 0 )
+            field = &io.cancelled_write_bytes;
+
+        if ( field )
+        {
+            const char * position = colon + 1;
+            while ( position != line_end && *position == ' ' )
+                ++position;
+
+            for ( ; position != line_end && *position >= '0' && *position <= '9'; ++position )
+                *field = *field * 10 + ( *position - '0' );
+
+            ++parsed;
+        }
+
+        line = line_end + 1;
+    }
+
+    return parsed != 0;
+}
+
+// reads the I/O counters of a process. error, if given, is set to EACCES if
+// we may not read them, to the errno of any other syscall which failed, or to
+// 0, even if the file was read but could not be parsed
+static inline
+bool read_process_io( const pid_t pid, process_io & io, int * const error = nullptr )
+{
+    std::size_t length;
+    return read_procfs_scratch( pid, "io", length, error )
+        && parse_process_io( procfs_scratch_buffer(), length, io );
+}
+
+#if PS_HAVE_PROCFS
+/**@struct procfs_directory
+ * @brief Lists the pids of /proc with raw getdents64 calls
+ *
+ * The entries are read in large batches into a buffer which is reused
+ * from one scan to the next, and their type is taken from d_type, so
+ * no entry costs a stat call, an allocation or an exception. */
+struct procfs_directory : boost::noncopyable
+{
+    /**@brief Opens the procfs directory
+     * @param[in] path The mount point of procfs
+     * @param[in] buffer_size The number of bytes read per getdents64 call */
+    explicit
+    procfs_directory( const char * path = "/proc",
+                      std::size_t buffer_size = 64 * 1024 )
+        : m_fd( open( path, O_RDONLY | O_DIRECTORY | O_CLOEXEC ) )
+        , m_buffer( buffer_size )
+        , m_syscalls( 0 )
+    {
+    }
+
+    ~procfs_directory()
+    {
+        if ( m_fd != -1 )
+            close( m_fd );
+    }
+
+    bool is_open() const
+    {
+        return m_fd != -1;
+    }
+
+    /**@brief Returns the file descriptor of the directory */
+    int fd() const
+    {
+        return m_fd;
+    }
+
+    /**@brief Returns the number of getdents64 calls performed so far */
+    unsigned syscalls() const
+    {
+        return m_syscalls;
+    }
+
+    /**@brief Appends the pid of every running process to a container
+     * @param[out] pids Any container of pid_t with push_back(), such as std::pmr::vector
+     * @return false if the directory could not be read */
+    template< typename Container >
+    bool read_pids( Container & pids )
+    {
+        if ( !is_open() )
+            return false;
+
+        // start over, so that the same object can scan /proc repeatedly
+        if ( lseek( m_fd, 0, SEEK_SET ) == -1 )
+            return false;
+
+        for ( ;; )
+        {
+            const long length =
+                syscall( SYS_getdents64, m_fd, m_buffer.data(), m_buffer.size() );
+            ++m_syscalls;
+
+            if ( length < 0 )
+                return false;
+
+            if ( length == 0 )
+                return true;
+
+            for ( long offset = 0; offset < length; )
+            {
+                const dirent64_header * const entry =
+                    reinterpret_cast< const dirent64_header * >( &m_buffer[offset] );
+                offset += entry->d_reclen;
+
+                // some filesystems do not fill d_type, in which case the name decides
+                if ( entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN )
+                    continue;
+
+                pid_t pid;
+                if ( parse_pid( entry->d_name, pid ) )
+                    pids.push_back( pid );
+            }
+        }
+    }
+
+private:
+    // the layout of the records returned by getdents64
+    struct dirent64_header
+    {
+        uint64_t       d_ino;
+        int64_t        d_off;
+        unsigned short d_reclen;
+        unsigned char  d_type;
+        char           d_name[1];
+    };
+
+    int                 m_fd;
+    std::vector< char > m_buffer;
+    unsigned            m_syscalls;
+};
+
+// returns a directory private to the calling thread, which keeps its buffer
+// from one scan to the next
+static inline
+procfs_directory & thread_procfs_directory()
+{
+    static thread_local procfs_directory proc;
+    return proc;
+}
+#endif
+
+} // ns details
+
+/**@brief Returns the pid of every process listed in /proc, in ascending order
+ *
+ * On platforms without procfs, this returns an empty container. */
+inline
+std::vector< pid_t > get_pids_from_procfs()
+{
+#if PS_HAVE_PROCFS
+    // the pids are listed into a buffer reused from one call to the next, so
+    // that the result is allocated once, at its final size
+    static thread_local std::vector< pid_t > listed;
+    listed.clear();
+    details::thread_procfs_directory().read_pids( listed );
+
+    std::vector< pid_t > pids( listed.begin(), listed.end() );
+    std::sort( pids.begin(), pids.end() );
+    return pids;
+#else
+    return std::vector< pid_t >();
+#endif
+}
+
+#if PS_HAVE_PROCFS
+/**@struct memory_reader
+ * @brief Reads the memory of the same processes over and over, keeping their statm files open
+ *
+ * Opening a file of /proc costs several times more than reading it, so the
+ * statm file of every process read is kept open, and read again from its
+ * beginning with pread. A file stays bound to the process it was opened for:
+ * once that process has exited, reading fails and the file is opened again,
+ * for whichever process has the pid by then.
+ *
+ * At most max_open files are kept open, the other processes are read the
+ * usual way. Calling sweep() after every round closes the files of the
+ * processes which were not read during that round. */
+struct memory_reader : boost::noncopyable
+{
+    explicit
+    memory_reader( const std::size_t max_open = 256 )
+        : m_max_open( max_open )
+    {
+    }
+
+    ~memory_reader()
+    {
+        for ( const auto & file : m_files )
+            close( file.second.fd );
+    }
+
+    /**@brief Reads the memory of a process
+     * @param[in] read_status Whether to read the peaks and the swap from
+     *            /proc/<pid>/status, which is opened every time
+     * @return false if the process does not exist, or cannot be read */
+    bool read( const pid_t pid, process_memory & memory, const bool read_status = false )
+    {
+        using namespace ps::details;
+        if ( !read_statm( pid, memory ) )
+            return false;
+
+        std::size_t length;
+        return !read_status
+            || ( read_procfs_scratch( pid, "status", length )
+                 && parse_status_memory( procfs_scratch_buffer(), length, memory ) );
+    }
+
+    /**@brief Closes the files of the processes not read since the previous sweep */
+    void sweep()
+    {
+        for ( auto file = m_files.begin(); file != m_files.end(); )
+        {
+            if ( file->second.used )
+            {
+                file->second.used = false;
+                ++file;
+            }
+            else
+            {
+                close( file->second.fd );
+                file = m_files.erase( file );
+            }
+        }
+    }
+
+    /**@brief Returns the number of statm files kept open */
+    std::size_t open_files() const
+    {
+        return m_files.size();
+    }
+
+private:
+    struct open_file
+    {
+        int  fd;
+        bool used;
+    };
+
+    bool read_statm( const pid_t pid, process_memory & memory )
+    {
+        using namespace ps::details;
+        auto file = m_files.find( pid );
+        if ( file != m_files.end() )
+        {
+            const ssize_t length = read_from_start( file->second.fd );
+            if ( length > 0 )
+            {
+                file->second.used = true;
+                return parse_statm( procfs_scratch_buffer(), static_cast< std::size_t >( length ), memory );
+            }
+
+            // the process has exited, and the pid may be someone else's now
+            close( file->second.fd );
+            m_files.erase( file );
+        }
+
+        if ( m_files.size() >= m_max_open )
+        {
+            std::size_t length;
+            return read_procfs_scratch( pid, "statm", length )
+                && parse_statm( procfs_scratch_buffer(), length, memory );
+        }
+
+        if ( pid == INVALID_PID )
+            return false;
+
+        char path[PROCFS_PATH_SIZE];
+        format_procfs_path( path, pid, "statm" );
+        const int fd = openat( procfs_dirfd(), path, O_RDONLY | O_CLOEXEC );
+        if ( fd == -1 )
+            return false;
+
+        const ssize_t length = read_from_start( fd );
+        if ( length <= 0 )
+        {
+            close( fd );
+            return false;
+        }
+
+        const open_file opened = { fd, true };
+        m_files.insert( std::make_pair( pid, opened ) );
+        return parse_statm( procfs_scratch_buffer(), static_cast< std::size_t >( length ), memory );
+    }
+
+    // reads a file into the scratch buffer of the calling thread
+    static ssize_t read_from_start( const int fd )
+    {
+        ssize_t length;
+        do
+        {
+            length = pread( fd, details::procfs_scratch_buffer(), details::PROCFS_SCRATCH_SIZE, 0 );
+        }
+        while ( length < 0 && errno == EINTR );
+
+        return length;
+    }
+
+    std::size_t                              m_max_open;
+    std::unordered_map< pid_t, open_file >   m_files;
+};
+#endif
+
+} // namespace ps
+
+#endif // PS_PROCFS_H
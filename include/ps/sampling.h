@@ -0,0 +1,134 @@
+#ifndef PS_SAMPLING_H
+#define PS_SAMPLING_H
+
+#include "config.h"
+#include "ps/common.h"
+#include "ps/procfs.h"
+
+namespace ps
+{
+namespace details
+{
+
+// the clock ticks per second of the times of /proc, see sysconf( _SC_CLK_TCK )
+static inline
+unsigned long long clock_ticks_per_second()
+{
+#if HAVE_UNISTD_H
+    const long ticks_per_second = sysconf( _SC_CLK_TCK );
+    if ( ticks_per_second > 0 )
+        return static_cast< unsigned long long >( ticks_per_second );
+#endif
+    return 100;
+}
+
+// parses the first number of /proc/uptime, "350735.47 234388.90", into clock ticks
+static inline
+bool parse_uptime( const char * const data, const std::size_t length,
+                   const unsigned long long ticks_per_second, unsigned long long & uptime )
+{
+    const char * const end = data + length;
+    const char * position = data;
+    if ( position == end || *position < '0' || *position > '9' )
+        return false;
+
+    unsigned long long seconds = 0;
+    for ( ; position != end && *position >= '0' && *position <= '9'; ++position )
+        seconds = seconds * 10 + ( *position - '0' );
+
+    unsigned long long hundredths = 0;
+    if ( position != end && *position == '.' )
+    {
+        ++position;
+        for ( unsigned digits = 0; digits < 2; ++digits )
+        {
+            hundredths *= 10;
+            if ( position != end && *position >= '0' && *position <= '9' )
+                hundredths += *position++ - '0';
+        }
+    }
+
+    uptime = seconds * ticks_per_second + hundredths * ticks_per_second / 100;
+    return true;
+}
+
+static inline
+bool read_uptime( const unsigned long long ticks_per_second, unsigned long long & uptime )
+{
+#if PS_HAVE_PROCFS
+    const file_descriptor file( openat( procfs_dirfd(), "uptime", O_RDONLY | O_CLOEXEC ) );
+    if ( file.get() == -1 )
+        return false;
+
+    char * const scratch = procfs_scratch_buffer();
+    ssize_t length;
+    do
+    {
+        length = ::read( file.get(), scratch, PROCFS_SCRATCH_SIZE );
+    }
+    while ( length < 0 && errno == EINTR );
+
+    return length > 0 && parse_uptime( scratch, static_cast< std::size_t >( length ), ticks_per_second, uptime );
+#else
+    ( void )ticks_per_second;
+    ( void )uptime;
+    return false;
+#endif
+}
+
+// counters are not supposed to go backwards, but iowait is known to, so
+// deltas never wrap around
+static inline
+unsigned long long counter_delta( const unsigned long long current,
+                                  const unsigned long long previous )
+{
+    return current > previous ? current - previous : 0;
+}
+
+// the counters of a process at one tick of a sampler
+template< typename Counters >
+struct process_sample
+{
+    pid_t              pid;
+    unsigned long long start_time;
+    Counters           counters;
+};
+
+// walks the samples of a tick along with those of the previous tick, both
+// sorted by pid, and calls function( sample, baseline ) for each sample of the
+// tick. Its growth since the previous tick is sample.counters - baseline:
+// - a process sampled at both ticks is identified by its pid and start time,
+//   and its baseline is its previous sample
+// - a process which started since the previous tick, at previous_uptime or
+//   later and maybe reusing a pid, is charged with all its counters: its
+//   baseline is zero
+// - any other process, which the previous tick missed, grew by nothing
+template< typename Counters, typename Function >
+static inline
+void match_samples( const std::vector< process_sample< Counters > > & current,
+                    const std::vector< process_sample< Counters > > & previous,
+                    const unsigned long long previous_uptime, Function function )
+{
+    const Counters zero = Counters();
+    typename std::vector< process_sample< Counters > >::const_iterator before = previous.begin();
+    for ( const process_sample< Counters > & sample : current )
+    {
+        while ( before != previous.end() && before->pid < sample.pid )
+            ++before;
+
+        const bool known = before != previous.end() && before->pid == sample.pid &&
+                           before->start_time == sample.start_time;
+
+        if ( known )
+            function( sample, before->counters );
+        else if ( sample.start_time >= previous_uptime )
+            function( sample, zero );
+        else
+            function( sample, sample.counters );
+    }
+}
+
+} // ns details
+} // namespace ps
+
+#endif // PS_SAMPLING_H
@@ -6,6 +6,9 @@
 #include "ps/process.h"
 #include "ps/cocoa.h"
 #include "ps/icon.h"
+#include "ps/procfs.h"
+#include "ps/worker_pool.h"
+#include "ps/io_uring.h"
 
 namespace ps
 {
@@ -20,7 +23,10 @@ enum flags
     ENUMERATE_ALL          = 0x3
 };
 
-snapshot get_entries_from_window_manager()
+inline
+std::vector< std::string > get_cmdlines_from_pids( const std::vector< pid_t > & );
+
+snapshot get_entries_from_window_manager( const fields wanted = FIELD_DEFAULT )
 {
     snapshot processes;
 #if HAVE_LIBWNCK
@@ -36,6 +42,9 @@ snapshot get_entries_from_window_manager()
 
     wnck_screen_force_update( screen );
 
+    std::vector< pid_t > pids;
+    std::vector< std::string > titles;
+
     for ( GList * window_l = wnck_screen_get_windows ( screen ); window_l != NULL;
             window_l = window_l->next )
     {
@@ -45,12 +54,16 @@ snapshot get_entries_from_window_manager()
 
         const pid_t pid = wnck_window_get_pid( window );
         assert( pid != ps::INVALID_PID );
-        processes.emplace_back(
-            pid,
-            get_cmdline_from_pid( pid ),
-            wnck_window_get_name( window )
-        );
+        pids.push_back( pid );
+        titles.push_back( ( wanted & FIELD_TITLE ) ? wnck_window_get_name( window ) : "" );
     }
+
+    // resolve every command line at once, instead of one /proc walk per window
+    const std::vector< std::string > cmdlines = ( wanted & FIELD_CMDLINE )
+        ? get_cmdlines_from_pids( pids )
+        : std::vector< std::string >( pids.size() );
+    for ( std::size_t i = 0; i < pids.size(); ++i )
+        processes.emplace_back( pids[i], cmdlines[i], titles[i] );
 #elif HAVE_WINUSER_H
 
     std::vector< pid_t > pids;
@@ -59,7 +72,7 @@ snapshot get_entries_from_window_manager()
         return snapshot();
 
     for ( const pid_t pid : pids )
-        processes.emplace_back( pid );
+        processes.emplace_back( pid, wanted );
 
 #else
     const int nb_of_applications =
@@ -82,7 +95,7 @@ snapshot get_entries_from_window_manager()
         if ( pid_array[i] == INVALID_PID )
             continue;
 
-        processes.emplace_back( pid_array[i] );
+        processes.emplace_back( pid_array[i], wanted );
     }
 
 exit:
@@ -94,103 +107,185 @@ exit:
     return processes;
 }
 
-static inline
-std::vector<pid_t> get_running_process_ids( const unsigned max_pids = 500 )
+namespace details
 {
-    std::vector<pid_t> pids;
-    pids.resize( max_pids, INVALID_PID );
 
-#if HAVE_LIBPROC_H
-    proc_listpids( PROC_ALL_PIDS, 0,
-                   const_cast<pid_t *>( pids.data() ),
-                   max_pids );
-#elif HAVE_ENUMPROCESSES
-    DWORD nbBytes;
-    EnumProcesses( const_cast<pid_t *>( pids.data() ),
-                   max_pids * sizeof( pid_t ), &nbBytes );
-    pids.resize( nbBytes / sizeof( pid_t ) );
-#endif
+// the highest pid_max linux accepts, used where the OS does not tell its own
+static PS_CONSTEXPR std::size_t PID_MAX_LIMIT = 4194304;
 
-    return pids;
-}
-
-snapshot get_entries_from_syscall()
+// the number of pids found by the previous enumeration, which sizes the next one
+static inline
+std::atomic< std::size_t > & previous_pid_count()
 {
-#if HAVE_LIBPROC_H
-    const unsigned max_pids = proc_listpids( PROC_ALL_PIDS, 0, nullptr, 0 );
-#else
-    const unsigned max_pids = 500;
-#endif
-
-    std::vector<pid_t> running_pids
-        = get_running_process_ids( max_pids );
-
-    return snapshot(
-               running_pids.begin(),
-               std::remove( running_pids.begin(), running_pids.end(), INVALID_PID )
-           );
+    static std::atomic< std::size_t > count( 0 );
+    return count;
 }
 
+// lists the pids through list( buffer, capacity, found ), which writes at most
+// capacity pids to buffer, sets found to the number written, and returns false
+// on error. A full buffer may have cut the list short, so it then doubles and
+// the list is read again, until fewer pids than capacity are found, or until
+// the buffer holds limit pids. Returns false on error, or if the list was truncated
+template< typename Lister >
 static inline
-bool read_entry_from_procfs( boost::filesystem::directory_iterator pos,
-                             std::string & cmdline, pid_t & pid )
+bool list_pids( std::vector< pid_t > & pids, std::size_t capacity, const std::size_t limit,
+                Lister list )
 {
-    using namespace boost::filesystem;
+    capacity = std::max< std::size_t >( 1, std::min( capacity, limit ) );
+    for ( ;; )
+    {
+        pids.resize( capacity, INVALID_PID );
 
-    // the path of a directory entry of /proc, something like /proc/12113
-    const path entry_path = absolute( pos->path() );
+        std::size_t found = 0;
+        if ( !list( pids.data(), capacity, found ) )
+        {
+            pids.clear();
+            return false;
+        }
 
-    if ( !is_directory( entry_path ) )
-        return false;
+        found = std::min( found, capacity );
+        if ( found < capacity || capacity >= limit )
+        {
+            pids.resize( found );
+            return found < capacity;
+        }
 
-    // we store the pid, which is the *filename* of the entry (/proc/12113)
-    try
-    {
-        pid = boost::lexical_cast<pid_t>( entry_path.filename().string().c_str() );
-    }
-    catch( const boost::bad_lexical_cast & )
-    {
-        // /proc also contains directory entries which are not processes, such as "dri"
-        return false;
+        capacity = std::min( limit, capacity * 2 );
     }
+}
 
-    // we make it an absolute entry, because we are not necessarily executing from /proc
-    // /proc/12113/cmdline contains the name of the process
-    const path path_to_cmdline = entry_path / "cmdline";
+} // ns details
 
-    // if cmdline does not exist, it might be that we just don't have the rights to read /proc/12113
-    if ( !exists( path_to_cmdline ) )
-        return false;
+/**@brief Returns the number of pids the OS can hand out
+ *
+ * On linux, this is /proc/sys/kernel/pid_max, on OS X, the kern.maxproc sysctl.
+ * @return The limit, or 0 if the OS does not tell it */
+inline
+std::size_t get_pid_max()
+{
+#if PS_HAVE_PROCFS
+    const details::file_descriptor file( open( "/proc/sys/kernel/pid_max", O_RDONLY | O_CLOEXEC ) );
+    if ( file.get() == -1 )
+        return 0;
+
+    char contents[32];
+    const ssize_t length = read( file.get(), contents, sizeof( contents ) - 1 );
+    if ( length <= 0 )
+        return 0;
+
+    contents[length] = '\0';
+    return static_cast< std::size_t >( strtoul( contents, nullptr, 10 ) );
+#elif HAVE_SYS_SYSCTL_H && DEFINED_KERN_MAXPROC
+    int mib[2] = { CTL_KERN, KERN_MAXPROC };
+    int max_processes = 0;
+    size_t size = sizeof( max_processes );
+    if ( sysctl( mib, 2, &max_processes, &size, NULL, 0 ) == -1 || max_processes <= 0 )
+        return 0;
+
+    return static_cast< std::size_t >( max_processes );
+#else
+    return 0;
+#endif
+}
 
-    // if we do not have the rights to read cmdline, then creating the ifstream may fail
-    std::ifstream cmdline_file( path_to_cmdline.c_str() );
-    if ( !cmdline_file.is_open() )
-        return false;
+/**@brief Lists the pids of the running processes, as the OS reports them
+ *
+ * The list is read into a buffer sized from the count of the previous call,
+ * with some margin for new processes. A full buffer may have cut the list
+ * short, so the buffer then doubles and the list is read again, until the OS
+ * returns fewer pids than the buffer holds, or until the buffer holds as
+ * many pids as the OS can hand out.
+ * @param[out] pids The pids found, in the order of the OS
+ * @return false if the list could not be read, or was truncated */
+inline
+bool get_running_process_ids( std::vector< pid_t > & pids )
+{
+    pids.clear();
+#if HAVE_LIBPROC_H || HAVE_ENUMPROCESSES
+    const std::size_t pid_max = get_pid_max();
+    const std::size_t limit = pid_max ? pid_max : details::PID_MAX_LIMIT;
+    const std::size_t capacity = std::max< std::size_t >( 1024, details::previous_pid_count() * 5 / 4 );
+
+    const bool complete = details::list_pids( pids, capacity, limit,
+                                              []( pid_t * const buffer, const std::size_t size, std::size_t & found )
+    {
+#if HAVE_LIBPROC_H
+        const int bytes = proc_listpids( PROC_ALL_PIDS, 0, buffer,
+                                         static_cast< int >( size * sizeof( pid_t ) ) );
+        if ( bytes < 0 )
+            return false;
+#else
+        DWORD bytes = 0;
+        if ( !EnumProcesses( reinterpret_cast< DWORD * >( buffer ),
+                             static_cast< DWORD >( size * sizeof( pid_t ) ), &bytes ) )
+            return false;
+#endif
+        found = static_cast< std::size_t >( bytes ) / sizeof( pid_t );
+        return true;
+    } );
 
-    // /proc/11241/cmdline contains the full name of the executable
-    std::getline( cmdline_file, cmdline );
+    // a failed listing tells nothing about the count
+    if ( complete || !pids.empty() )
+        details::previous_pid_count() = pids.size();
 
-    return true;
+    return complete;
+#elif PS_HAVE_PROCFS
+    // a directory listing is never truncated
+    return details::thread_procfs_directory().read_pids( pids );
+#else
+    return false;
+#endif
 }
 
-static inline
-bool read_entry_from_procfs(
-    boost::filesystem::directory_iterator pos,
-    process & out )
+/**@brief Lists at most max_pids pids of the running processes
+ *
+ * Kept for the callers of the previous interface, which could not tell a
+ * truncated list from a complete one.
+ * @see get_running_process_ids( std::vector< pid_t > & )
+ * @param[in] max_pids How many pids to return at most
+ * @return The pids found, in the order of the OS, or nothing if the list could not be read */
+inline
+std::vector< pid_t > get_running_process_ids( const unsigned max_pids = 500 )
 {
-    std::string cmdline;
-    pid_t pid;
+    std::vector< pid_t > pids;
+    get_running_process_ids( pids );
+    if ( pids.size() > max_pids )
+        pids.resize( max_pids );
+
+    return pids;
+}
+
+/**@brief Returns the processes listed by the OS
+ *
+ * On linux, /proc already lists every process, so this returns nothing.
+ * @param[in] wanted The attributes to read, the others are left empty
+ * @param[out] truncated Set to true if the OS listed too many processes to read them all */
+inline
+snapshot get_entries_from_syscall( const fields wanted = FIELD_DEFAULT, bool * const truncated = nullptr )
+{
+    snapshot processes;
+    if ( truncated )
+        *truncated = false;
 
-    if ( read_entry_from_procfs( pos, cmdline, pid ) )
+#if HAVE_LIBPROC_H || HAVE_ENUMPROCESSES
+    std::vector< pid_t > running_pids;
+    const bool complete = get_running_process_ids( running_pids );
+    if ( truncated )
+        *truncated = !complete && !running_pids.empty();
+
+    processes.reserve( running_pids.size() );
+    for ( const pid_t pid : running_pids )
     {
-        out = process( pid, cmdline );
-        return true;
+        if ( pid != INVALID_PID )
+            processes.emplace_back( pid, wanted );
     }
+#else
+    ( void )wanted;
+#endif
 
-    return false;
+    return processes;
 }
 
-
 inline
 std::string get_cmdline_from_pid( const pid_t pid )
 {
@@ -228,68 +323,619 @@ std::string get_cmdline_from_pid( const pid_t pid )
     return convert_kernel_drive_to_msdos_drive(
                std::string( buffer.get(), buffer.get() + length ) );
 #else
-    boost::filesystem::directory_iterator pos( "/proc" );
-    for ( ; pos != boost::filesystem::directory_iterator(); ++pos )
+    std::string cmdline;
+    if ( !details::read_procfs_file( pid, "cmdline", cmdline ) )
+        return "";
+
+    return cmdline;
+#endif
+}
+
+/**@brief Returns the absolute path to the binary executable run by a process
+ *
+ * On linux, this resolves the /proc/<pid>/exe link, so it costs a single
+ * syscall. Elsewhere, it is the same as get_cmdline_from_pid().
+ * @param[in] pid The process id given by the OS
+ * @return The path to the executable, or "" if it cannot be accessed */
+inline
+std::string get_executable_from_pid( const pid_t pid )
+{
+#if HAVE_LIBPROC_H || HAVE_PSAPI_H
+    return get_cmdline_from_pid( pid );
+#else
+    if ( pid == INVALID_PID )
+        return "";
+
+    const std::string link_path = "/proc/" + std::to_string( pid ) + "/exe";
+
+    std::vector< char > buffer( 4096 );
+    const ssize_t length = readlink( link_path.c_str(), buffer.data(), buffer.size() );
+    if ( length <= 0 )
+        return "";
+
+    return std::string( buffer.data(), length );
+#endif
+}
+
+/**@brief Returns the command lines of several processes at once
+ *
+ * Each pid is resolved directly, so resolving K pids costs O(K) syscalls
+ * whatever the number of running processes.
+ * @param[in] pids The process ids to resolve
+ * @return One command line per pid, in the same order. Pids which cannot
+ *         be resolved map to "" */
+inline
+std::vector< std::string > get_cmdlines_from_pids( const std::vector< pid_t > & pids )
+{
+    std::vector< std::string > cmdlines;
+    cmdlines.reserve( pids.size() );
+
+    for ( const pid_t pid : pids )
+        cmdlines.push_back( get_cmdline_from_pid( pid ) );
+
+    return cmdlines;
+}
+
+/**@brief Reads every process listed in /proc, spreading the reads over several threads
+ *
+ * The result does not depend on the number of threads nor on the read backend:
+ * processes are sorted by pid. Asking for FIELD_PID alone costs nothing but
+ * the getdents64 scan of /proc.
+ * @param[in] options How many threads may read /proc concurrently, and how
+ * @param[in] wanted The attributes to read. Only FIELD_CMDLINE, FIELD_NAME,
+ *            FIELD_STAT, the memory and FIELD_IO are available from /proc */
+inline
+snapshot get_entries_from_procfs( const parallel_options & options,
+                                  const fields wanted = FIELD_DEFAULT )
+{
+    const std::vector< pid_t > pids = get_pids_from_procfs();
+    const bool read_cmdline = ( wanted & FIELD_CMDLINE ) != 0;
+    const bool read_stat = ( wanted & ( FIELD_NAME | FIELD_STAT ) ) != 0;
+    const bool read_memory = ( wanted & ( FIELD_MEMORY | FIELD_MEMORY_STATUS ) ) != 0;
+    const bool read_status = ( wanted & FIELD_MEMORY_STATUS ) != 0;
+    const bool read_io = ( wanted & FIELD_IO ) != 0;
+
+    // every pid has its own slot, so that workers never share any state
+    std::vector< std::string > cmdlines( read_cmdline ? pids.size() : 0 );
+    std::vector< details::stat_identity > identities( read_stat ? pids.size() : 0 );
+    std::vector< process_stat > stats( read_stat ? pids.size() : 0 );
+    std::vector< process_memory > memories( read_memory ? pids.size() : 0 );
+    std::vector< process_io > ios( read_io ? pids.size() : 0 );
+    std::vector< char > found( pids.size(), 1 );
+
+    // io_uring reads whole batches of files per syscall, so work is shared by batch
+    const bool use_io_uring = options.backend == READ_IO_URING;
+    const std::size_t batch_size = use_io_uring ? 256 : 1;
+    const std::size_t batches = ( pids.size() + batch_size - 1 ) / batch_size;
+
+    if ( read_cmdline || read_stat || read_memory || read_io )
     {
-        std::string cmdline;
-        pid_t current_pid;
-        if ( read_entry_from_procfs( pos, cmdline, current_pid ) && pid == current_pid )
-            return cmdline;
+        details::parallel_for( batches, options, [&]( const std::size_t batch )
+        {
+            const std::size_t first = batch * batch_size;
+            const std::size_t count = std::min( batch_size, pids.size() - first );
+
+            // the process may have exited since /proc was listed, or we may
+            // not have the rights to read its command line
+            if ( read_cmdline )
+                details::read_procfs_files( &pids[first], count, "cmdline",
+                                            &cmdlines[first], &found[first], use_io_uring );
+
+            for ( std::size_t i = first; read_stat && i < first + count; ++i )
+            {
+                if ( found[i] )
+                    found[i] = details::read_stat_identity( pids[i], identities[i], stats[i] );
+            }
+
+            // the memory is left at 0 if it cannot be read, the process is kept
+            for ( std::size_t i = first; read_memory && i < first + count; ++i )
+            {
+                if ( found[i] )
+                    details::read_process_memory( pids[i], memories[i], read_status );
+            }
+
+            // the counters of the processes of other users cannot be read, and are left at 0
+            for ( std::size_t i = first; read_io && i < first + count; ++i )
+            {
+                if ( found[i] )
+                    details::read_process_io( pids[i], ios[i] );
+            }
+        } );
     }
-    return "";
-#endif
+
+    snapshot all_processes;
+    all_processes.reserve( pids.size() );
+
+    for ( std::size_t i = 0; i < pids.size(); ++i )
+    {
+        if ( !found[i] )
+            continue;
+
+        all_processes.emplace_back(
+            pids[i],
+            read_cmdline ? PS_MOVE( cmdlines[i] ) : std::string(),
+            ( wanted & FIELD_NAME ) ? PS_MOVE( identities[i].comm ) : std::string(),
+            ( wanted & FIELD_STAT ) ? identities[i].start_time : 0 );
+
+        if ( wanted & FIELD_STAT )
+            all_processes.back().set_stat( stats[i] );
+        if ( read_memory )
+            all_processes.back().set_memory( memories[i] );
+        if ( read_io )
+            all_processes.back().set_io( ios[i] );
+    }
+
+    return all_processes;
 }
 
 inline
 snapshot get_entries_from_procfs()
 {
-    using namespace boost::filesystem;
+    return get_entries_from_procfs( parallel_options( 1 ) );
+}
+
+namespace details
+{
+
+// reads every process listed in /proc from the calling thread, and interns
+// the strings from the buffer they are read into: a command line or a name
+// already in the pool is never copied
+static inline
+snapshot get_interned_entries_from_procfs( const fields wanted, string_pool & pool )
+{
+    const std::vector< pid_t > pids = get_pids_from_procfs();
+    std::string cmdline;
+    stat_identity identity;
+    process_stat stat;
+
     snapshot all_processes;
+    all_processes.reserve( pids.size() );
+    for ( const pid_t pid : pids )
+    {
+        // the process may have exited since /proc was listed
+        cmdline.clear();
+        if ( ( wanted & FIELD_CMDLINE ) && !read_procfs_file( pid, "cmdline", cmdline ) )
+            continue;
+
+        if ( ( wanted & ( FIELD_NAME | FIELD_STAT ) ) && !read_stat_identity( pid, identity, stat ) )
+            continue;
+
+        all_processes.push_back( process() );
+        process & p = all_processes.back();
+        p.reset( pid, cmdline,
+                 ( wanted & FIELD_NAME ) ? boost::string_ref( identity.comm ) : boost::string_ref(),
+                 ( wanted & FIELD_STAT ) ? identity.start_time : 0, pool );
+
+        if ( wanted & FIELD_STAT )
+            p.set_stat( stat );
+
+        if ( wanted & ( FIELD_MEMORY | FIELD_MEMORY_STATUS ) )
+        {
+            process_memory memory;
+            read_process_memory( pid, memory, ( wanted & FIELD_MEMORY_STATUS ) != 0 );
+            p.set_memory( memory );
+        }
+
+        if ( wanted & FIELD_IO )
+        {
+            process_io io;
+            read_process_io( pid, io );
+            p.set_io( io );
+        }
+    }
+
+    return all_processes;
+}
+
+} // ns details
+
+namespace details
+{
 
-    try
+// joins the processes of a source with those already captured, on their pid:
+// a new pid is moved in, a known one completes the process already there.
+// The processes already captured are only indexed once a source has to be
+// joined with them, so that a capture with a single source allocates no node
+static inline
+void join_by_pid( snapshot & all_processes,
+                  std::unordered_map< pid_t, std::size_t > & positions,
+                  snapshot && source )
+{
+    if ( source.empty() )
+        return;
+
+    if ( positions.size() != all_processes.size() )
     {
-        directory_iterator pos( "/proc" );
-        // until this is the last iterator, try and retrieve the process info
-        for ( ; pos != directory_iterator(); ++pos )
+        positions.reserve( all_processes.size() + source.size() );
+        for ( std::size_t i = 0; i < all_processes.size(); ++i )
+            positions.insert( std::make_pair( all_processes[i].pid(), i ) );
+    }
+
+    for ( process & p : source )
+    {
+        if ( !p.valid() )
+            continue;
+
+        const auto position = positions.find( p.pid() );
+        if ( position == positions.end() )
         {
-            process next_process;
-            if ( read_entry_from_procfs( pos, next_process ) )
-                all_processes.push_back( PS_MOVE( next_process ) );
+            positions.insert( std::make_pair( p.pid(), all_processes.size() ) );
+            all_processes.push_back( PS_MOVE( p ) );
+        }
+        else
+        {
+            all_processes[position->second].merge( PS_MOVE( p ) );
         }
     }
-    catch ( boost::filesystem::filesystem_error & )
+}
+
+} // ns details
+
+/**@brief Captures the running processes, reading only the attributes asked for
+ *
+ * Every source is joined on the pid, so that each process appears once. The
+ * processes read from /proc or from the OS come first, and the window manager
+ * only completes them, with a title for instance.
+ * @param[in] flags Which kinds of processes to enumerate
+ * @param[in] wanted The attributes to read, the others are left empty
+ * @param[in] options How many threads may read /proc concurrently
+ * @return One process per pid, sorted by pid */
+inline
+snapshot capture( const ps::flags flags, const fields wanted,
+                  const parallel_options & options = parallel_options( 1 ) )
+{
+    using namespace ps::details;
+    snapshot all_processes;
+    std::unordered_map< pid_t, std::size_t > positions;
+
+    if ( flags & ps::ENUMERATE_BSD_APPS )
     {
+        // the pids of /proc are unique, so they need no join
+        all_processes = get_entries_from_procfs( options, wanted );
+        join_by_pid( all_processes, positions, get_entries_from_syscall( wanted ) );
     }
 
+    if ( flags & ps::ENUMERATE_DESKTOP_APPS )
+        join_by_pid( all_processes, positions, get_entries_from_window_manager( wanted ) );
+
+    std::sort( all_processes.begin(), all_processes.end(),
+               []( const process & left, const process & right )
+    {
+        return left.pid() < right.pid();
+    } );
+
+    return all_processes;
+}
+
+/**@brief Captures the running processes, storing their strings in a pool
+ *
+ * Processes with the same command line, name, title or version share one
+ * copy of it. Passing the same pool to consecutive captures also shares the
+ * strings from one capture to the next. On linux, when only ENUMERATE_BSD_APPS
+ * is asked for from a single thread, the strings are interned as they are
+ * read, so that those already in the pool are never allocated.
+ * @param[in] flags Which kinds of processes to enumerate
+ * @param[in] wanted The attributes to read, the others are left empty
+ * @param[in,out] pool Where the strings are interned
+ * @param[in] options How many threads may read /proc concurrently */
+inline
+snapshot capture( const ps::flags flags, const fields wanted, string_pool & pool,
+                  const parallel_options & options = parallel_options( 1 ) )
+{
+#if PS_HAVE_PROCFS
+    if ( flags == ENUMERATE_BSD_APPS && options.thread_count() == 1 && options.backend == READ_SYNCHRONOUS )
+        return details::get_interned_entries_from_procfs( wanted, pool );
+#endif
+
+    snapshot all_processes = capture( flags, wanted, options );
+    for ( process & p : all_processes )
+        p.intern( pool );
+
     return all_processes;
 }
 
+/**@brief Captures the running processes, reading /proc over several threads
+ * @param[in] flags Which kinds of processes to enumerate
+ * @param[in] options How many threads may read /proc concurrently */
+inline
+snapshot capture( const ps::flags flags, const parallel_options & options )
+{
+    return capture( flags, FIELD_DEFAULT, options );
+}
+
 inline
 snapshot capture( const ps::flags flags = ps::ENUMERATE_ALL )
 {
+    return capture( flags, parallel_options( 1 ) );
+}
+
+namespace details
+{
+
+#if PS_HAVE_PROCFS
+// what capture_into() reads /proc into, kept from one capture to the next
+struct capture_scratch
+{
+    std::vector< pid_t > pids;
+    std::string          cmdline;
+    stat_identity        identity;
+    process_stat         stat;
+    process_memory       memory;
+    process_io           io;
+};
+
+static inline
+capture_scratch & thread_capture_scratch()
+{
+    static thread_local capture_scratch scratch;
+    return scratch;
+}
+
+// reads the attributes of a pid into a process
+static inline
+bool refresh_from_procfs( process & p, const pid_t pid, const fields wanted,
+                          capture_scratch & scratch )
+{
+    const bool read_cmdline = ( wanted & FIELD_CMDLINE ) != 0;
+    const bool read_stat = ( wanted & ( FIELD_NAME | FIELD_STAT ) ) != 0;
+
+    scratch.cmdline.clear();
+    scratch.identity.comm.clear();
+    scratch.identity.start_time = 0;
+
+    if ( read_cmdline && !read_procfs_file( pid, "cmdline", scratch.cmdline ) )
+        return false;
+
+    if ( read_stat && !read_stat_identity( pid, scratch.identity, scratch.stat ) )
+        return false;
+
+    p.reset( pid,
+             scratch.cmdline,
+             ( wanted & FIELD_NAME ) ? boost::string_ref( scratch.identity.comm ) : boost::string_ref(),
+             ( wanted & FIELD_STAT ) ? scratch.identity.start_time : 0 );
+
+    if ( wanted & FIELD_STAT )
+        p.set_stat( scratch.stat );
+
+    scratch.memory = process_memory();
+    if ( ( wanted & ( FIELD_MEMORY | FIELD_MEMORY_STATUS ) ) &&
+         read_process_memory( pid, scratch.memory, ( wanted & FIELD_MEMORY_STATUS ) != 0 ) )
+        p.set_memory( scratch.memory );
+
+    scratch.io = process_io();
+    if ( ( wanted & FIELD_IO ) && read_process_io( pid, scratch.io ) )
+        p.set_io( scratch.io );
+    return true;
+}
+#endif
+
+} // ns details
+
+/**@brief Captures the running processes into a snapshot, reusing its storage
+ *
+ * The processes of the snapshot which are still running are read again in
+ * place, those which exited are recycled for the new ones, and strings are
+ * only written when they changed. Polling with the same snapshot thus does
+ * not allocate once the set of processes is stable, unlike capture() which
+ * builds a new snapshot every time.
+ *
+ * Processes which share their strings with a copy, or which were interned,
+ * are left untouched as long as they do not change. The window manager, and
+ * platforms without /proc, fall back to a regular capture.
+ * @param[in,out] out The snapshot to overwrite, usually the one of the previous
+ *                call. Afterwards, it holds what capture() returns, sorted by pid
+ * @param[in] flags Which kinds of processes to enumerate
+ * @param[in] wanted The attributes to read, the others are left empty */
+inline
+void capture_into( snapshot & out, const ps::flags flags = ps::ENUMERATE_ALL,
+                   const fields wanted = FIELD_DEFAULT )
+{
+#if PS_HAVE_PROCFS
     using namespace ps::details;
-    snapshot all_processes;
+    const auto by_pid = []( const process & left, const process & right )
+    {
+        return left.pid() < right.pid();
+    };
 
-    if ( flags & ps::ENUMERATE_BSD_APPS )
+    if ( !( flags & ps::ENUMERATE_BSD_APPS ) )
     {
-        const snapshot bsd_processes = get_entries_from_syscall();
-        all_processes.insert( all_processes.end(), bsd_processes.begin(),
-                              bsd_processes.end() );
+        out = capture( flags, wanted );
+        return;
+    }
+
+    capture_scratch & scratch = thread_capture_scratch();
+    scratch.pids.clear();
+    thread_procfs_directory().read_pids( scratch.pids );
+    std::sort( scratch.pids.begin(), scratch.pids.end() );
+
+    if ( !std::is_sorted( out.begin(), out.end(), by_pid ) )
+        std::sort( out.begin(), out.end(), by_pid );
 
-        const snapshot procfs_entries = get_entries_from_procfs();
-        all_processes.insert( all_processes.end(), procfs_entries.begin(),
-                              procfs_entries.end() );
+    // the processes still running move to the front, in order. Those which
+    // exited stay behind, for their storage to be reused
+    std::size_t kept = 0;
+    for ( std::size_t i = 0; i < out.size(); ++i )
+    {
+        if ( std::binary_search( scratch.pids.begin(), scratch.pids.end(), out[i].pid() ) &&
+             ( kept == 0 || out[kept - 1].pid() != out[i].pid() ) )
+        {
+            if ( i != kept )
+                std::swap( out[kept], out[i] );
+            ++kept;
+        }
     }
 
+    // refresh the processes kept, and fill the others in with the new pids
+    std::size_t used = 0;
+    std::size_t next_kept = 0;
+    std::size_t next_free = kept;
+    for ( const pid_t pid : scratch.pids )
+    {
+        std::size_t slot;
+        if ( next_kept < kept && out[next_kept].pid() == pid )
+        {
+            slot = next_kept++;
+        }
+        else
+        {
+            if ( next_free == out.size() )
+                out.emplace_back();
+            slot = next_free++;
+        }
+
+        // a process which exited since /proc was listed is recycled as well
+        if ( !refresh_from_procfs( out[slot], pid, wanted, scratch ) )
+            out[slot].reset( INVALID_PID, boost::string_ref(), boost::string_ref(), 0 );
+        else
+            ++used;
+    }
+
+    // the processes which could not be read sort after the others, and are dropped
+    std::sort( out.begin(), out.begin() + next_free, []( const process & left, const process & right )
+    {
+        return left.valid() != right.valid() ? left.valid() : left.pid() < right.pid();
+    } );
+    out.erase( out.begin() + used, out.end() );
+
     if ( flags & ps::ENUMERATE_DESKTOP_APPS )
     {
-        const snapshot gui_applications =
-            get_entries_from_window_manager();
-        all_processes.insert( all_processes.end(), gui_applications.begin(),
-                              gui_applications.end() );
+        for ( process & p : get_entries_from_window_manager( wanted ) )
+        {
+            const auto found = std::lower_bound( out.begin(), out.end(), p, by_pid );
+            if ( found != out.end() && found->pid() == p.pid() )
+                found->merge( PS_MOVE( p ) );
+            else if ( p.valid() )
+                out.insert( found, PS_MOVE( p ) );
+        }
     }
+#else
+    out = capture( flags, wanted );
+#endif
+}
 
-    return all_processes;
+/**@struct snapshot_delta
+ * @brief What changed between two snapshots
+ *
+ * Processes are identified by their pid and their start time, so that a pid
+ * reused by a new process shows up as one exited and one added process. */
+struct snapshot_delta
+{
+    snapshot current; ///< every running process, sorted by pid
+    snapshot added;   ///< processes which were not in the previous snapshot
+    snapshot exited;  ///< processes of the previous snapshot which are gone
+    snapshot changed; ///< processes which executed another program since then
+};
+
+/**@brief Captures the processes listed in /proc, reusing a previous capture
+ *
+ * Only /proc/<pid>/stat is read for the processes of the previous snapshot,
+ * to check that they are still the same. Their command line is read again only
+ * if their name changed, so steady-state polling costs one small read per
+ * process, and a few more per new process.
+ *
+ * The processes of the returned snapshots have their name() and start_time()
+ * set. Pass an empty snapshot on the first call, then the current snapshot of
+ * the previous result: processes without a start time never match.
+ * @param[in] previous The snapshot to compare the running processes against
+ * @param[in] options How many threads may read /proc concurrently */
+inline
+snapshot_delta capture_delta( const snapshot & previous,
+                              const parallel_options & options = parallel_options( 1 ) )
+{
+    using namespace ps::details;
+    snapshot_delta delta;
+
+    std::unordered_map< pid_t, const process * > previous_by_pid;
+    previous_by_pid.reserve( previous.size() );
+    for ( const process & p : previous )
+    {
+        if ( p.valid() && p.start_time() != 0 )
+            previous_by_pid[p.pid()] = &p;
+    }
+
+    const std::vector< pid_t > pids = get_pids_from_procfs();
+    std::vector< stat_identity > identities( pids.size() );
+    std::vector< char > alive( pids.size(), 0 );
+
+    parallel_for( pids.size(), options, [&]( const std::size_t i )
+    {
+        alive[i] = read_stat_identity( pids[i], identities[i] );
+    } );
+
+    // the processes which are new, or which are not running the same program
+    std::vector< std::size_t > unknown;
+    std::vector< const process * > matches( pids.size(), nullptr );
+    for ( std::size_t i = 0; i < pids.size(); ++i )
+    {
+        if ( !alive[i] )
+            continue;
+
+        const auto match = previous_by_pid.find( pids[i] );
+        if ( match != previous_by_pid.end() &&
+             match->second->start_time() == identities[i].start_time )
+        {
+            matches[i] = match->second;
+            previous_by_pid.erase( match );
+
+            if ( matches[i]->name() == identities[i].comm )
+                continue;
+        }
+
+        unknown.push_back( i );
+    }
+
+    std::vector< std::string > cmdlines( unknown.size() );
+    std::vector< char > found( unknown.size(), 0 );
+    parallel_for( unknown.size(), options, [&]( const std::size_t i )
+    {
+        found[i] = read_procfs_file( pids[unknown[i]], "cmdline", cmdlines[i] );
+    } );
+
+    delta.current.reserve( pids.size() );
+    for ( std::size_t i = 0, next_unknown = 0; i < pids.size(); ++i )
+    {
+        if ( !alive[i] )
+            continue;
+
+        const bool is_unknown =
+            next_unknown < unknown.size() && unknown[next_unknown] == i;
+
+        if ( !is_unknown )
+        {
+            delta.current.push_back( *matches[i] );
+            continue;
+        }
+
+        // the process may have exited since its stat file was read
+        if ( !found[next_unknown] )
+        {
+            if ( matches[i] )
+                delta.exited.push_back( *matches[i] );
+
+            ++next_unknown;
+            continue;
+        }
+
+        delta.current.emplace_back( pids[i], cmdlines[next_unknown], "",
+                                    identities[i].comm, "",
+                                    identities[i].start_time );
+        ++next_unknown;
+
+        if ( matches[i] )
+            delta.changed.push_back( delta.current.back() );
+        else
+            delta.added.push_back( delta.current.back() );
+    }
+
+    // whatever was not matched is not running anymore
+    for ( const process & p : previous )
+    {
+        const auto unmatched = previous_by_pid.find( p.pid() );
+        if ( unmatched != previous_by_pid.end() && unmatched->second == &p )
+            delta.exited.push_back( p );
+    }
+
+    return delta;
 }
 
 #if !HAVE_APPKIT_NSRUNNINGAPPLICATION_H || !HAVE_APPKIT_NSWORKSPACE_H || !HAVE_FOUNDATION_FOUNDATION_H
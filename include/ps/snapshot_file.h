@@ -0,0 +1,350 @@
+#ifndef PS_SNAPSHOT_FILE_H
+#define PS_SNAPSHOT_FILE_H
+
+#include "config.h"
+#include "ps/common.h"
+#include "ps/process.h"
+#include "ps/snapshot.h"
+#include "ps/snapshot_table.h"
+
+#if HAVE_SYS_MMAN_H && HAVE_SYS_STAT_H && HAVE_FCNTL_H && HAVE_UNISTD_H
+#   define PS_HAVE_MAPPED_SNAPSHOT 1
+#else
+#   define PS_HAVE_MAPPED_SNAPSHOT 0
+#endif
+
+namespace ps
+{
+
+/**@brief The version of the snapshot files written by save() */
+static PS_CONSTEXPR uint32_t SNAPSHOT_FILE_VERSION = 1;
+
+/**@brief Set in snapshot_file_header::flags when the rows are sorted by pid */
+static PS_CONSTEXPR uint32_t SNAPSHOT_FILE_SORTED = 0x1;
+
+/**@struct snapshot_file_header
+ * @brief The beginning of a snapshot file
+ *
+ * A snapshot file is made of this header, followed by fixed-width columns,
+ * then by the characters of every string:
+ *   - the pids, as int32_t, padded to a multiple of 8 bytes
+ *   - the start times, as uint64_t
+ *   - the string_span of every string, column after column, in the order of string_column
+ *   - the characters the spans point into
+ *
+ * Every offset is counted from the beginning of the file, so a file can be
+ * mapped anywhere in memory and used in place. */
+struct snapshot_file_header
+{
+    char     magic[8];           ///< "PSSNAP\r\n"
+    uint32_t version;            ///< SNAPSHOT_FILE_VERSION
+    uint32_t byte_order;         ///< 0x01020304, as written by the machine which saved the file
+    uint64_t rows;               ///< the number of processes
+    uint64_t arena_size;         ///< the number of characters of the strings
+    uint32_t flags;              ///< SNAPSHOT_FILE_SORTED, or 0
+    uint32_t reserved;
+    uint64_t pids_offset;
+    uint64_t start_times_offset;
+    uint64_t spans_offset;
+    uint64_t arena_offset;
+};
+
+namespace details
+{
+
+static PS_CONSTEXPR char SNAPSHOT_FILE_MAGIC[8] = { 'P', 'S', 'S', 'N', 'A', 'P', '\r', '\n' };
+static PS_CONSTEXPR uint32_t SNAPSHOT_FILE_BYTE_ORDER = 0x01020304;
+
+static inline
+uint64_t align_to_8( const uint64_t size )
+{
+    return ( size + 7 ) & ~static_cast< uint64_t >( 7 );
+}
+
+// fills the offsets of a header from its number of rows and characters
+static inline
+void layout_snapshot_file( snapshot_file_header & header )
+{
+    header.pids_offset        = sizeof( snapshot_file_header );
+    header.start_times_offset = header.pids_offset + align_to_8( header.rows * sizeof( int32_t ) );
+    header.spans_offset       = header.start_times_offset + header.rows * sizeof( uint64_t );
+    header.arena_offset       = header.spans_offset + header.rows * COLUMN_COUNT * sizeof( string_span );
+}
+
+static inline
+bool write_all( FILE * const file, const void * const data, const std::size_t size )
+{
+    return size == 0 || fwrite( data, 1, size, file ) == size;
+}
+
+} // ns details
+
+/**@brief Writes a table to a snapshot file
+ *
+ * The file is written next to its destination, then renamed, so that readers
+ * never see a partial file.
+ * @param[in] table The processes to save
+ * @param[in] path Where to write the file
+ * @return false if the file could not be written */
+template< typename Allocator >
+bool save( const basic_snapshot_table< Allocator > & table, const std::string & path )
+{
+    using namespace ps::details;
+    static_assert( sizeof( snapshot_file_header ) % 8 == 0, "the columns are aligned on 8 bytes" );
+    static_assert( sizeof( string_span ) == 8, "spans are written as they are stored" );
+
+    snapshot_file_header header;
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.magic, SNAPSHOT_FILE_MAGIC, sizeof( header.magic ) );
+    header.version    = SNAPSHOT_FILE_VERSION;
+    header.byte_order = SNAPSHOT_FILE_BYTE_ORDER;
+    header.rows       = table.size();
+    header.arena_size = table.arena().size();
+    header.flags      = std::is_sorted( table.pids().begin(), table.pids().end() )
+                        ? SNAPSHOT_FILE_SORTED : 0;
+    layout_snapshot_file( header );
+
+    const std::string temporary_path = path + ".tmp";
+    FILE * const file = fopen( temporary_path.c_str(), "wb" );
+    if ( !file )
+        return false;
+
+    bool success = write_all( file, &header, sizeof( header ) );
+
+    // pid_t is not 32 bits wide everywhere, so pids are converted by chunks
+    int32_t pids[1024];
+    for ( std::size_t first = 0; success && first < table.size(); first += 1024 )
+    {
+        const std::size_t count = std::min< std::size_t >( 1024, table.size() - first );
+        for ( std::size_t i = 0; i < count; ++i )
+            pids[i] = static_cast< int32_t >( table.pids()[first + i] );
+
+        success = write_all( file, pids, count * sizeof( int32_t ) );
+    }
+
+    const char padding[8] = { 0 };
+    success = success && write_all( file, padding,
+                                    header.start_times_offset - header.pids_offset
+                                    - header.rows * sizeof( int32_t ) );
+
+    for ( std::size_t i = 0; success && i < table.size(); ++i )
+    {
+        const uint64_t start_time = table.start_times()[i];
+        success = write_all( file, &start_time, sizeof( start_time ) );
+    }
+
+    for ( unsigned column = 0; success && column < COLUMN_COUNT; ++column )
+    {
+        const auto & spans = table.spans( static_cast< string_column >( column ) );
+        success = write_all( file, spans.data(), spans.size() * sizeof( string_span ) );
+    }
+
+    success = success && write_all( file, table.arena().data(), table.arena().size() );
+    success = ( fclose( file ) == 0 ) && success;
+
+    if ( success )
+        success = rename( temporary_path.c_str(), path.c_str() ) == 0;
+
+    if ( !success )
+        remove( temporary_path.c_str() );
+
+    return success;
+}
+
+/**@brief Writes a snapshot to a snapshot file
+ * @param[in] processes The processes to save
+ * @param[in] path Where to write the file
+ * @return false if the file could not be written */
+inline
+bool save( const snapshot & processes, const std::string & path )
+{
+    return save( snapshot_table( processes ), path );
+}
+
+#if PS_HAVE_MAPPED_SNAPSHOT
+/**@struct mapped_snapshot
+ * @brief Reads a snapshot file in place, through mmap
+ *
+ * Opening a file only checks its header: nothing is parsed, copied or
+ * allocated, so opening a large archive and looking up one pid costs a few
+ * page faults. The strings returned point into the mapping, and are valid
+ * until the file is closed. */
+struct mapped_snapshot : boost::noncopyable
+{
+    /**@brief Returned by find_pid() when no row matches */
+    static PS_CONSTEXPR std::size_t npos = static_cast< std::size_t >( -1 );
+
+    mapped_snapshot()
+        : m_data( nullptr )
+        , m_size( 0 )
+        , m_header( nullptr )
+    {
+    }
+
+    explicit
+    mapped_snapshot( const std::string & path )
+        : m_data( nullptr )
+        , m_size( 0 )
+        , m_header( nullptr )
+    {
+        open( path );
+    }
+
+    ~mapped_snapshot()
+    {
+        close();
+    }
+
+    /**@brief Maps a snapshot file
+     * @return false if the file cannot be read, or is not a valid snapshot file */
+    bool open( const std::string & path )
+    {
+        close();
+
+        const int fd = ::open( path.c_str(), O_RDONLY | O_CLOEXEC );
+        if ( fd == -1 )
+            return false;
+
+        struct stat status;
+        if ( fstat( fd, &status ) != 0 ||
+             static_cast< uint64_t >( status.st_size ) < sizeof( snapshot_file_header ) )
+        {
+            ::close( fd );
+            return false;
+        }
+
+        void * const data = mmap( nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+        ::close( fd );
+
+        if ( data == MAP_FAILED )
+            return false;
+
+        m_data = static_cast< const char * >( data );
+        m_size = status.st_size;
+        m_header = reinterpret_cast< const snapshot_file_header * >( m_data );
+
+        if ( !is_valid() )
+        {
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void close()
+    {
+        if ( m_data )
+            munmap( const_cast< char * >( m_data ), m_size );
+
+        m_data = nullptr;
+        m_size = 0;
+        m_header = nullptr;
+    }
+
+    bool is_open() const
+    {
+        return m_data != nullptr;
+    }
+
+    /**@brief Returns the number of processes in the file */
+    std::size_t size() const
+    {
+        return m_header ? static_cast< std::size_t >( m_header->rows ) : 0;
+    }
+
+    pid_t pid( const std::size_t index ) const
+    {
+        assert( index < size() );
+        return static_cast< pid_t >( pids()[index] );
+    }
+
+    unsigned long long start_time( const std::size_t index ) const
+    {
+        assert( index < size() );
+        return reinterpret_cast< const uint64_t * >( m_data + m_header->start_times_offset )[index];
+    }
+
+    /**@brief Returns a string of the file, without copying it
+     *
+     * A span pointing outside of the file, which only a corrupted file has,
+     * gives an empty string. */
+    boost::string_ref string_at( const string_column column, const std::size_t index ) const
+    {
+        assert( column < COLUMN_COUNT && index < size() );
+        const string_span span = reinterpret_cast< const string_span * >(
+                                     m_data + m_header->spans_offset )[column * m_header->rows + index];
+
+        if ( static_cast< uint64_t >( span.offset ) + span.length > m_header->arena_size )
+            return boost::string_ref();
+
+        return boost::string_ref( m_data + m_header->arena_offset + span.offset, span.length );
+    }
+
+    /**@brief Returns the index of the row of a pid, or npos
+     *
+     * Files of sorted snapshots, such as those of capture(), are binary searched. */
+    std::size_t find_pid( const pid_t pid ) const
+    {
+        const int32_t * const first = pids();
+        const int32_t * const last = first + size();
+        const int32_t wanted = static_cast< int32_t >( pid );
+
+        const int32_t * const found = ( m_header && ( m_header->flags & SNAPSHOT_FILE_SORTED ) )
+                                      ? std::lower_bound( first, last, wanted )
+                                      : std::find( first, last, wanted );
+
+        return ( found != last && *found == wanted )
+               ? static_cast< std::size_t >( found - first ) : npos;
+    }
+
+    /**@brief Copies a row of the file into a process */
+    process to_process( const std::size_t index ) const
+    {
+        return process( pid( index ),
+                        string_at( COLUMN_CMDLINE, index ).to_string(),
+                        string_at( COLUMN_TITLE, index ).to_string(),
+                        string_at( COLUMN_NAME, index ).to_string(),
+                        string_at( COLUMN_VERSION, index ).to_string(),
+                        start_time( index ) );
+    }
+
+private:
+    const int32_t * pids() const
+    {
+        return m_header ? reinterpret_cast< const int32_t * >( m_data + m_header->pids_offset )
+                        : nullptr;
+    }
+
+    // checks that the header is one of ours, and that the columns fit in the file
+    bool is_valid() const
+    {
+        using namespace ps::details;
+        if ( memcmp( m_header->magic, SNAPSHOT_FILE_MAGIC, sizeof( m_header->magic ) ) != 0 ||
+             m_header->version != SNAPSHOT_FILE_VERSION ||
+             m_header->byte_order != SNAPSHOT_FILE_BYTE_ORDER )
+            return false;
+
+        // a huge row count would overflow the computation of the offsets
+        if ( m_header->rows > m_size || m_header->arena_size > m_size )
+            return false;
+
+        snapshot_file_header expected = *m_header;
+        layout_snapshot_file( expected );
+
+        return expected.pids_offset        == m_header->pids_offset
+            && expected.start_times_offset == m_header->start_times_offset
+            && expected.spans_offset       == m_header->spans_offset
+            && expected.arena_offset       == m_header->arena_offset
+            && m_header->arena_offset + m_header->arena_size <= m_size;
+    }
+
+    const char *                 m_data;
+    std::size_t                  m_size;
+    const snapshot_file_header * m_header;
+};
+#endif
+
+} // namespace ps
+
+#endif // PS_SNAPSHOT_FILE_H
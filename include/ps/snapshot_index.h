@@ -0,0 +1,402 @@
+#ifndef PS_SNAPSHOT_INDEX_H
+#define PS_SNAPSHOT_INDEX_H
+
+#include "config.h"
+#include "ps/common.h"
+#include "ps/process.h"
+#include "ps/snapshot.h"
+#include "ps/string_pool.h"
+
+namespace ps
+{
+namespace details
+{
+
+// the first argument of a command line, whose arguments are separated by
+// null characters on linux
+static inline
+boost::string_ref executable_of( const std::string & cmdline )
+{
+    const std::size_t end = cmdline.find( '\0' );
+    return boost::string_ref( cmdline.data(), end == std::string::npos ? cmdline.size() : end );
+}
+
+static PS_CONSTEXPR uint32_t NO_STRING_GROUP = static_cast< uint32_t >( -1 );
+
+// the smallest power of 2 which keeps a table at most half full
+static inline
+std::size_t open_addressing_capacity( const std::size_t entries )
+{
+    std::size_t capacity = 16;
+    while ( capacity < entries * 2 )
+        capacity *= 2;
+
+    return capacity;
+}
+
+static inline
+std::size_t hash_pid( const pid_t pid )
+{
+    // fibonacci hashing spreads consecutive pids over the table
+    return static_cast< std::size_t >(
+               ( static_cast< uint64_t >( static_cast< uint32_t >( pid ) ) * 11400714819323198485ULL ) >> 32 );
+}
+
+/**@struct string_index
+ * @brief Groups the rows of a snapshot which share a string
+ *
+ * The rows of every group are stored contiguously, so that looking a string
+ * up gives a range. Groups are found through an open addressing table which
+ * stores their hash, so that most mismatches are rejected without reading
+ * any string. Empty strings are not indexed. */
+struct string_index
+{
+    typedef std::vector< uint32_t >::const_iterator row_iterator;
+
+    template< typename Key >
+    void build( const snapshot & processes, Key key )
+    {
+        m_groups.clear();
+        m_rows.assign( processes.size(), 0 );
+        m_slots.assign( open_addressing_capacity( processes.size() ), slot() );
+
+        // first pass: find the group of every row and count the rows of each group
+        std::vector< uint32_t > group_of_row( processes.size(), NO_STRING_GROUP );
+        for ( std::size_t row = 0; row < processes.size(); ++row )
+        {
+            const boost::string_ref value = key( processes[row] );
+            if ( value.empty() )
+                continue;
+
+            const std::size_t hash = string_ref_hash()( value );
+            slot & s = m_slots[find_slot( value, hash )];
+            if ( s.group == NO_STRING_GROUP )
+            {
+                s.hash = hash;
+                s.group = static_cast< uint32_t >( m_groups.size() );
+                m_groups.push_back( group( value ) );
+            }
+
+            group_of_row[row] = s.group;
+            ++m_groups[s.group].count;
+        }
+
+        // second pass: place the rows of every group one after the other
+        uint32_t first = 0;
+        for ( group & g : m_groups )
+        {
+            g.first = first;
+            first += g.count;
+            g.count = 0;
+        }
+
+        m_rows.resize( first );
+        for ( std::size_t row = 0; row < processes.size(); ++row )
+        {
+            if ( group_of_row[row] == NO_STRING_GROUP )
+                continue;
+
+            group & g = m_groups[group_of_row[row]];
+            m_rows[g.first + g.count++] = static_cast< uint32_t >( row );
+        }
+    }
+
+    std::pair< row_iterator, row_iterator > find( const boost::string_ref value ) const
+    {
+        if ( value.empty() || m_slots.empty() )
+            return std::make_pair( m_rows.end(), m_rows.end() );
+
+        const slot & s = m_slots[find_slot( value, string_ref_hash()( value ) )];
+        if ( s.group == NO_STRING_GROUP )
+            return std::make_pair( m_rows.end(), m_rows.end() );
+
+        const group & g = m_groups[s.group];
+        return std::make_pair( m_rows.begin() + g.first, m_rows.begin() + g.first + g.count );
+    }
+
+    /**@brief Returns the number of distinct strings */
+    std::size_t size() const
+    {
+        return m_groups.size();
+    }
+
+private:
+    struct slot
+    {
+        slot()
+            : hash( 0 )
+            , group( NO_STRING_GROUP )
+        {
+        }
+
+        std::size_t hash;
+        uint32_t    group;
+    };
+
+    struct group
+    {
+        explicit
+        group( const boost::string_ref k )
+            : key( k )
+            , first( 0 )
+            , count( 0 )
+        {
+        }
+
+        boost::string_ref key;
+        uint32_t          first;
+        uint32_t          count;
+    };
+
+    // returns the slot of a string, or the empty slot where it belongs
+    std::size_t find_slot( const boost::string_ref value, const std::size_t hash ) const
+    {
+        const std::size_t mask = m_slots.size() - 1;
+        for ( std::size_t i = hash & mask; ; i = ( i + 1 ) & mask )
+        {
+            const slot & s = m_slots[i];
+            if ( s.group == NO_STRING_GROUP ||
+                 ( s.hash == hash && m_groups[s.group].key == value ) )
+                return i;
+        }
+    }
+
+    std::vector< slot >     m_slots;
+    std::vector< group >    m_groups;
+    std::vector< uint32_t > m_rows;
+};
+
+} // ns details
+
+/**@struct snapshot_index
+ * @brief Finds the processes of a snapshot by pid, executable, command line or name
+ *
+ * The index is built once per capture, in linear time, after which every
+ * lookup is a probe of a flat open addressing table instead of a std::find_if
+ * over the whole snapshot.
+ *
+ * The index refers to the processes and the strings of the snapshot it was
+ * built from: the snapshot must outlive the index, and must not be modified
+ * until the index is rebuilt. */
+struct snapshot_index
+{
+    /**@struct range
+     * @brief The processes sharing a string, in the order of the snapshot */
+    struct range
+    {
+        struct const_iterator
+        {
+            typedef std::forward_iterator_tag iterator_category;
+            typedef process                   value_type;
+            typedef std::ptrdiff_t            difference_type;
+            typedef const process *           pointer;
+            typedef const process &           reference;
+
+            const_iterator( const snapshot * const processes,
+                            const details::string_index::row_iterator row )
+                : m_processes( processes )
+                , m_row( row )
+            {
+            }
+
+            const process & operator*() const
+            {
+                return ( *m_processes )[*m_row];
+            }
+
+            const process * operator->() const
+            {
+                return &**this;
+            }
+
+            /**@brief Returns the position of the process in the snapshot */
+            std::size_t index() const
+            {
+                return *m_row;
+            }
+
+            const_iterator & operator++()
+            {
+                ++m_row;
+                return *this;
+            }
+
+            const_iterator operator++( int )
+            {
+                const_iterator previous( *this );
+                ++m_row;
+                return previous;
+            }
+
+            std::ptrdiff_t operator-( const const_iterator & other ) const
+            {
+                return m_row - other.m_row;
+            }
+
+            bool operator==( const const_iterator & other ) const
+            {
+                return m_row == other.m_row;
+            }
+
+            bool operator!=( const const_iterator & other ) const
+            {
+                return m_row != other.m_row;
+            }
+
+        private:
+            const snapshot *                    m_processes;
+            details::string_index::row_iterator m_row;
+        };
+
+        range( const snapshot * const processes,
+               const std::pair< details::string_index::row_iterator,
+                                details::string_index::row_iterator > & rows )
+            : m_begin( processes, rows.first )
+            , m_end( processes, rows.second )
+        {
+        }
+
+        const_iterator begin() const
+        {
+            return m_begin;
+        }
+
+        const_iterator end() const
+        {
+            return m_end;
+        }
+
+        std::size_t size() const
+        {
+            return static_cast< std::size_t >( m_end - m_begin );
+        }
+
+        bool empty() const
+        {
+            return m_begin == m_end;
+        }
+
+    private:
+        const_iterator m_begin;
+        const_iterator m_end;
+    };
+
+    snapshot_index()
+        : m_processes( nullptr )
+    {
+    }
+
+    explicit
+    snapshot_index( const snapshot & processes )
+        : m_processes( nullptr )
+    {
+        build( processes );
+    }
+
+    /**@brief Indexes a snapshot, replacing the previous one
+     * @param[in] processes The processes to index, which must outlive the index */
+    void build( const snapshot & processes )
+    {
+        using namespace ps::details;
+        m_processes = &processes;
+
+        // slots hold the position of the process + 1, so that 0 marks an empty slot
+        m_pid_slots.assign( open_addressing_capacity( processes.size() ), pid_slot() );
+        const std::size_t mask = m_pid_slots.size() - 1;
+        for ( std::size_t row = 0; row < processes.size(); ++row )
+        {
+            const pid_t pid = processes[row].pid();
+            std::size_t i = hash_pid( pid ) & mask;
+
+            // the first process of a pid wins, as for std::find_if
+            while ( m_pid_slots[i].row != 0 && m_pid_slots[i].pid != pid )
+                i = ( i + 1 ) & mask;
+
+            if ( m_pid_slots[i].row == 0 )
+            {
+                m_pid_slots[i].pid = pid;
+                m_pid_slots[i].row = static_cast< uint32_t >( row + 1 );
+            }
+        }
+
+        m_cmdlines.build( processes, []( const process & p )
+        {
+            return boost::string_ref( p.cmdline() );
+        } );
+
+        m_executables.build( processes, []( const process & p )
+        {
+            return executable_of( p.cmdline() );
+        } );
+
+        m_names.build( processes, []( const process & p )
+        {
+            return boost::string_ref( p.name() );
+        } );
+    }
+
+    /**@brief Returns the number of processes indexed */
+    std::size_t size() const
+    {
+        return m_processes ? m_processes->size() : 0;
+    }
+
+    /**@brief Returns the process of a pid, or nullptr */
+    const process * find_pid( const pid_t pid ) const
+    {
+        if ( m_pid_slots.empty() )
+            return nullptr;
+
+        const std::size_t mask = m_pid_slots.size() - 1;
+        for ( std::size_t i = details::hash_pid( pid ) & mask; m_pid_slots[i].row != 0; i = ( i + 1 ) & mask )
+        {
+            if ( m_pid_slots[i].pid == pid )
+                return &( *m_processes )[m_pid_slots[i].row - 1];
+        }
+
+        return nullptr;
+    }
+
+    /**@brief Returns the processes with a given command line */
+    range find_cmdline( const boost::string_ref cmdline ) const
+    {
+        return range( m_processes, m_cmdlines.find( cmdline ) );
+    }
+
+    /**@brief Returns the processes running a given executable
+     *
+     * The executable is the first argument of the command line. */
+    range find_executable( const boost::string_ref executable ) const
+    {
+        return range( m_processes, m_executables.find( executable ) );
+    }
+
+    /**@brief Returns the processes with a given name */
+    range find_name( const boost::string_ref name ) const
+    {
+        return range( m_processes, m_names.find( name ) );
+    }
+
+private:
+    struct pid_slot
+    {
+        pid_slot()
+            : pid( INVALID_PID )
+            , row( 0 )
+        {
+        }
+
+        pid_t    pid;
+        uint32_t row;
+    };
+
+    const snapshot *        m_processes;
+    std::vector< pid_slot > m_pid_slots;
+    details::string_index   m_cmdlines;
+    details::string_index   m_executables;
+    details::string_index   m_names;
+};
+
+} // namespace ps
+
+#endif // PS_SNAPSHOT_INDEX_H
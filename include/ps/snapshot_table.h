@@ -0,0 +1,496 @@
+#ifndef PS_SNAPSHOT_TABLE_H
+#define PS_SNAPSHOT_TABLE_H
+
+#include "config.h"
+#include "ps/common.h"
+#include "ps/process.h"
+#include "ps/snapshot.h"
+
+#if HAVE_MEMORY_RESOURCE && defined( __cpp_lib_memory_resource )
+#   define PS_HAVE_PMR 1
+#else
+#   define PS_HAVE_PMR 0
+#endif
+
+namespace ps
+{
+
+/**@brief The string attributes stored by a snapshot_table */
+enum string_column
+{
+    COLUMN_CMDLINE = 0,
+    COLUMN_TITLE   = 1,
+    COLUMN_NAME    = 2,
+    COLUMN_VERSION = 3,
+    COLUMN_COUNT   = 4
+};
+
+/**@struct string_span
+ * @brief Locates a string in the arena of a snapshot_table */
+struct string_span
+{
+    uint32_t offset; ///< the position of the first character in the arena
+    uint32_t length; ///< the number of characters, there is no terminating '\0'
+};
+
+/**@struct basic_snapshot_table
+ * @brief A snapshot of the running processes, stored column by column
+ *
+ * The pids and start times are kept in contiguous arrays. Every string
+ * attribute is an offset and a length into a single arena, so a table holds
+ * a handful of heap blocks whatever the number of processes, and looking for
+ * a pid or a name only walks packed memory.
+ *
+ * Rows are read through basic_snapshot_table::row, which offers the accessors
+ * of a process without copying any string.
+ *
+ * Every column is allocated through Allocator, which is rebound to the type
+ * of the column. See snapshot_table, and pmr::snapshot_table. */
+template< typename Allocator >
+struct basic_snapshot_table
+{
+    typedef Allocator allocator_type;
+    typedef std::allocator_traits< Allocator > traits;
+    typedef std::vector< pid_t, typename traits::template rebind_alloc< pid_t > > pid_vector;
+    typedef std::vector< unsigned long long,
+                         typename traits::template rebind_alloc< unsigned long long > > time_vector;
+    typedef std::vector< string_span, typename traits::template rebind_alloc< string_span > > span_vector;
+    typedef std::vector< char, typename traits::template rebind_alloc< char > > char_vector;
+
+    /**@struct row
+     * @brief A read-only view on one process of a table
+     *
+     * It is only valid as long as the table is not modified. */
+    struct row
+    {
+        row( const basic_snapshot_table & table, const std::size_t index )
+            : m_table( &table )
+            , m_index( index )
+        {
+        }
+
+        pid_t pid() const
+        {
+            return m_table->m_pids[m_index];
+        }
+
+        unsigned long long start_time() const
+        {
+            return m_table->m_start_times[m_index];
+        }
+
+        boost::string_ref cmdline() const
+        {
+            return m_table->string_at( COLUMN_CMDLINE, m_index );
+        }
+
+        boost::string_ref title() const
+        {
+            return m_table->string_at( COLUMN_TITLE, m_index );
+        }
+
+        boost::string_ref name() const
+        {
+            return m_table->string_at( COLUMN_NAME, m_index );
+        }
+
+        boost::string_ref version() const
+        {
+            return m_table->string_at( COLUMN_VERSION, m_index );
+        }
+
+        bool valid() const
+        {
+            return pid() != INVALID_PID;
+        }
+
+        /**@brief Returns the position of this row in its table */
+        std::size_t index() const
+        {
+            return m_index;
+        }
+
+        /**@brief Copies this row into a process */
+        process to_process() const
+        {
+            return process( pid(), cmdline().to_string(), title().to_string(),
+                            name().to_string(), version().to_string(), start_time() );
+        }
+
+    private:
+        const basic_snapshot_table * m_table;
+        std::size_t            m_index;
+    };
+
+    /**@struct const_iterator
+     * @brief Walks the rows of a table, in order */
+    struct const_iterator
+    {
+        typedef std::forward_iterator_tag iterator_category;
+        typedef row                       value_type;
+        typedef std::ptrdiff_t            difference_type;
+        typedef const row *               pointer;
+        typedef row                       reference;
+
+        const_iterator( const basic_snapshot_table & table, const std::size_t index )
+            : m_table( &table )
+            , m_index( index )
+        {
+        }
+
+        row operator*() const
+        {
+            return row( *m_table, m_index );
+        }
+
+        const_iterator & operator++()
+        {
+            ++m_index;
+            return *this;
+        }
+
+        const_iterator operator++( int )
+        {
+            const const_iterator previous( *this );
+            ++m_index;
+            return previous;
+        }
+
+        bool operator==( const const_iterator & other ) const
+        {
+            return m_index == other.m_index && m_table == other.m_table;
+        }
+
+        bool operator!=( const const_iterator & other ) const
+        {
+            return !( *this == other );
+        }
+
+    private:
+        const basic_snapshot_table * m_table;
+        std::size_t            m_index;
+    };
+
+    /**@brief Returned by the find functions when no row matches */
+    static PS_CONSTEXPR std::size_t npos = static_cast< std::size_t >( -1 );
+
+    /**@brief Creates an empty table
+     * @param[in] allocator Where the columns are allocated */
+    explicit
+    basic_snapshot_table( const Allocator & allocator = Allocator() )
+        : m_pids( allocator )
+        , m_start_times( allocator )
+        , m_spans { span_vector( allocator ), span_vector( allocator ),
+                    span_vector( allocator ), span_vector( allocator ) }
+        , m_arena( allocator )
+    {
+        static_assert( COLUMN_COUNT == 4, "one span column per string column" );
+    }
+
+    /**@brief Stores the processes of a snapshot, in the same order
+     * @param[in] allocator Where the columns are allocated */
+    explicit
+    basic_snapshot_table( const snapshot & processes,
+                          const Allocator & allocator = Allocator() )
+        : basic_snapshot_table( allocator )
+    {
+        std::size_t characters = 0;
+        for ( const process & p : processes )
+        {
+            characters += p.cmdline().size() + p.title().size()
+                        + p.name().size() + p.version().size();
+        }
+
+        reserve( processes.size(), characters );
+        for ( const process & p : processes )
+            push_back( p );
+    }
+
+    /**@brief Makes room for rows and for the characters of their strings */
+    void reserve( const std::size_t rows, const std::size_t characters )
+    {
+        m_pids.reserve( rows );
+        m_start_times.reserve( rows );
+        for ( span_vector & spans : m_spans )
+            spans.reserve( rows );
+        m_arena.reserve( characters );
+    }
+
+    /**@brief Appends a row
+     * @param[in] pid The process id given by the OS
+     * @param[in] start_time When the process started, see process::start_time()
+     * @param[in] strings The attributes of the process, indexed by string_column
+     * @return false if the strings do not fit in the 4 GiB the spans can address,
+     *         in which case the table is left unchanged */
+    bool push_back( const pid_t pid, const unsigned long long start_time,
+                    const boost::string_ref ( &strings )[COLUMN_COUNT] )
+    {
+        std::size_t characters = 0;
+        for ( const boost::string_ref & value : strings )
+            characters += value.size();
+
+        if ( characters > UINT32_MAX - m_arena.size() )
+            return false;
+
+        m_pids.push_back( pid );
+        m_start_times.push_back( start_time );
+        for ( unsigned column = 0; column < COLUMN_COUNT; ++column )
+            m_spans[column].push_back( append( strings[column] ) );
+
+        return true;
+    }
+
+    /**@brief Appends a copy of a process
+     * @return false if its strings do not fit in the table, see push_back() */
+    bool push_back( const process & p )
+    {
+        const boost::string_ref strings[COLUMN_COUNT] = { p.cmdline(), p.title(), p.name(), p.version() };
+        return push_back( p.pid(), p.start_time(), strings );
+    }
+
+    /**@brief Removes every row, but keeps the memory for the next capture */
+    void clear()
+    {
+        m_pids.clear();
+        m_start_times.clear();
+        for ( span_vector & spans : m_spans )
+            spans.clear();
+        m_arena.clear();
+    }
+
+    std::size_t size() const
+    {
+        return m_pids.size();
+    }
+
+    bool empty() const
+    {
+        return m_pids.empty();
+    }
+
+    row operator[]( const std::size_t index ) const
+    {
+        assert( index < size() );
+        return row( *this, index );
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator( *this, 0 );
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator( *this, size() );
+    }
+
+    allocator_type get_allocator() const
+    {
+        return allocator_type( m_arena.get_allocator() );
+    }
+
+    /**@brief Returns the pid column */
+    const pid_vector & pids() const
+    {
+        return m_pids;
+    }
+
+    /**@brief Returns the start time column */
+    const time_vector & start_times() const
+    {
+        return m_start_times;
+    }
+
+    /**@brief Returns where the strings of a column are in the arena */
+    const span_vector & spans( const string_column column ) const
+    {
+        assert( column < COLUMN_COUNT );
+        return m_spans[column];
+    }
+
+    /**@brief Returns the characters of every string of the table */
+    const char_vector & arena() const
+    {
+        return m_arena;
+    }
+
+    /**@brief Returns a string of the table, without copying it */
+    boost::string_ref string_at( const string_column column, const std::size_t index ) const
+    {
+        assert( column < COLUMN_COUNT && index < size() );
+        const string_span span = m_spans[column][index];
+        return boost::string_ref( m_arena.data() + span.offset, span.length );
+    }
+
+    /**@brief Returns the index of the row of a pid, or npos */
+    std::size_t find_pid( const pid_t pid ) const
+    {
+        const auto found = std::find( m_pids.begin(), m_pids.end(), pid );
+        return found == m_pids.end() ? npos : static_cast< std::size_t >( found - m_pids.begin() );
+    }
+
+    /**@brief Returns the indices of the rows whose string in a column is value */
+    std::vector< std::size_t > find( const string_column column,
+                                     const boost::string_ref value ) const
+    {
+        std::vector< std::size_t > matches;
+        const span_vector & spans = m_spans[column];
+        const char * const arena = m_arena.data();
+
+        // compare the lengths first, so most rows never touch the arena
+        for ( std::size_t i = 0; i < spans.size(); ++i )
+        {
+            if ( spans[i].length == value.size() &&
+                 std::equal( value.begin(), value.end(), arena + spans[i].offset ) )
+                matches.push_back( i );
+        }
+
+        return matches;
+    }
+
+    /**@brief Copies the table into a snapshot */
+    snapshot to_snapshot() const
+    {
+        snapshot processes;
+        processes.reserve( size() );
+        for ( const row r : *this )
+            processes.push_back( r.to_process() );
+
+        return processes;
+    }
+
+private:
+    // push_back() checked that the arena stays addressable
+    string_span append( const boost::string_ref value )
+    {
+        string_span span;
+        span.offset = static_cast< uint32_t >( m_arena.size() );
+        span.length = static_cast< uint32_t >( value.size() );
+        m_arena.insert( m_arena.end(), value.begin(), value.end() );
+        return span;
+    }
+
+    pid_vector  m_pids;
+    time_vector m_start_times;
+    span_vector m_spans[COLUMN_COUNT];
+    char_vector m_arena;
+};
+
+/**@brief A snapshot_table allocated on the heap */
+typedef basic_snapshot_table< std::allocator< char > > snapshot_table;
+
+#if PS_HAVE_PMR
+namespace pmr
+{
+/**@brief A snapshot_table allocated from a std::pmr::memory_resource */
+typedef basic_snapshot_table< std::pmr::polymorphic_allocator< char > > snapshot_table;
+} // namespace pmr
+#endif
+
+namespace details
+{
+
+// reads /proc/<pid> from the calling thread straight into the table, for
+// each of the sorted pids. Every command line is read into the same buffer,
+// then copied once, into the arena
+template< typename Table, typename Pids, typename String >
+static inline
+void read_procfs_into_table( Table & table, const Pids & pids, const fields wanted,
+                             String & cmdline, basic_stat_identity< String > & identity )
+{
+    // most command lines are a few dozen characters long
+    table.reserve( pids.size(), ( wanted & FIELD_CMDLINE ) ? 64 * pids.size() : 0 );
+
+    for ( const pid_t pid : pids )
+    {
+        // the process may have exited since /proc was listed
+        cmdline.clear();
+        if ( ( wanted & FIELD_CMDLINE ) && !read_procfs_file( pid, "cmdline", cmdline ) )
+            continue;
+
+        if ( ( wanted & ( FIELD_NAME | FIELD_STAT ) ) && !read_stat_identity( pid, identity ) )
+            continue;
+
+        const boost::string_ref strings[COLUMN_COUNT] =
+        {
+            boost::string_ref( cmdline.data(), cmdline.size() ),
+            boost::string_ref(),
+            ( wanted & FIELD_NAME ) ? boost::string_ref( identity.comm.data(), identity.comm.size() )
+                                    : boost::string_ref(),
+            boost::string_ref()
+        };
+
+        table.push_back( pid, ( wanted & FIELD_STAT ) ? identity.start_time : 0, strings );
+    }
+}
+
+} // ns details
+
+/**@brief Captures the running processes into a table
+ *
+ * On linux, when only ENUMERATE_BSD_APPS is asked for from a single thread,
+ * /proc is read straight into the columns of the table, without building the
+ * processes of a snapshot first.
+ * @param[in] flags Which kinds of processes to enumerate
+ * @param[in] wanted The attributes to read, the others are left empty
+ * @param[in] options How many threads may read /proc concurrently
+ * @return One row per pid, sorted by pid */
+inline
+snapshot_table capture_table( const ps::flags flags = ps::ENUMERATE_ALL,
+                              const fields wanted = FIELD_DEFAULT,
+                              const parallel_options & options = parallel_options( 1 ) )
+{
+#if PS_HAVE_PROCFS
+    if ( flags == ENUMERATE_BSD_APPS && options.thread_count() == 1 && options.backend == READ_SYNCHRONOUS )
+    {
+        snapshot_table table;
+        std::string cmdline;
+        details::stat_identity identity;
+        details::read_procfs_into_table( table, get_pids_from_procfs(), wanted, cmdline, identity );
+        return table;
+    }
+#endif
+
+    return snapshot_table( capture( flags, wanted, options ) );
+}
+
+#if PS_HAVE_PMR
+/**@brief Captures the running processes into a table allocated from a memory resource
+ *
+ * On linux, when only ENUMERATE_BSD_APPS is asked for, the calling thread reads
+ * /proc straight into the table, and every allocation of the capture, temporary
+ * buffers included, goes through resource. A whole capture can then live in a
+ * std::pmr::monotonic_buffer_resource and be released in one step. Otherwise,
+ * the processes are captured as usual, then copied into the table.
+ * @param[in] flags Which kinds of processes to enumerate
+ * @param[in] wanted The attributes to read, the others are left empty
+ * @param[in] resource Where the table and the temporary buffers are allocated
+ * @return One row per pid, sorted by pid */
+inline
+pmr::snapshot_table capture( const ps::flags flags, const fields wanted,
+                             std::pmr::memory_resource * const resource )
+{
+#if PS_HAVE_PROCFS
+    if ( flags == ENUMERATE_BSD_APPS )
+    {
+        pmr::snapshot_table table( resource );
+
+        std::pmr::vector< pid_t > pids( resource );
+        details::thread_procfs_directory().read_pids( pids );
+        std::sort( pids.begin(), pids.end() );
+
+        std::pmr::string cmdline( resource );
+        details::basic_stat_identity< std::pmr::string > identity( resource );
+        details::read_procfs_into_table( table, pids, wanted, cmdline, identity );
+
+        return table;
+    }
+#endif
+
+    return pmr::snapshot_table( capture( flags, wanted ), resource );
+}
+#endif
+
+} // namespace ps
+
+#endif // PS_SNAPSHOT_TABLE_H
@@ -0,0 +1,206 @@
+#ifndef PS_STRING_POOL_H
+#define PS_STRING_POOL_H
+
+#include "config.h"
+#include "ps/common.h"
+
+namespace ps
+{
+namespace details
+{
+
+/**@struct shared_string
+ * @brief A string which either owns its characters, or shares those of a string_pool
+ *
+ * An owned string holds a std::string, and an empty pointer to the pool: it
+ * weighs more than a std::string, but allocates no more. Once interned, copies
+ * of the string share one immutable allocation with every equal string of the pool. */
+struct shared_string
+{
+    shared_string()
+    {
+    }
+
+    shared_string( const char * const value )
+        : m_owned( value )
+    {
+    }
+
+    shared_string( const std::string & value )
+        : m_owned( value )
+    {
+    }
+
+#if HAVE_STD__MOVE
+    shared_string( std::string && value )
+        : m_owned( std::move( value ) )
+    {
+    }
+#endif
+
+    explicit
+    shared_string( const std::shared_ptr< const std::string > & pooled )
+        : m_pooled( pooled )
+    {
+    }
+
+    /**@brief Returns the characters, without copying them */
+    const std::string & str() const
+    {
+        return m_pooled ? *m_pooled : m_owned;
+    }
+
+    bool empty() const
+    {
+        return str().empty();
+    }
+
+    /**@brief Checks whether this string was interned in a pool */
+    bool is_pooled() const
+    {
+        return static_cast< bool >( m_pooled );
+    }
+
+    /**@brief Checks whether two strings share the same storage
+     *
+     * Strings interned by the same pool share their storage if and only if
+     * they are equal, so this replaces a comparison of their characters. Empty
+     * strings, which have no characters to store, always share their storage. */
+    bool same_storage( const shared_string & other ) const
+    {
+        if ( empty() && other.empty() )
+            return true;
+
+        return m_pooled ? m_pooled == other.m_pooled
+                        : &m_owned == &other.m_owned;
+    }
+
+    /**@brief Returns the storage shared with the pool, or null if the string is owned */
+    const std::shared_ptr< const std::string > & pooled() const
+    {
+        return m_pooled;
+    }
+
+    /**@brief Replaces the characters, reusing the capacity of an owned string
+     *
+     * Assigning the characters the string already has changes nothing, so a
+     * pooled string stays pooled. */
+    void assign( const boost::string_ref value )
+    {
+        if ( value == boost::string_ref( str() ) )
+            return;
+
+        m_pooled.reset();
+        m_owned.assign( value.begin(), value.end() );
+    }
+
+    void swap( shared_string & other )
+    {
+        m_owned.swap( other.m_owned );
+        m_pooled.swap( other.m_pooled );
+    }
+
+private:
+    std::string                          m_owned;
+    std::shared_ptr< const std::string > m_pooled;
+};
+
+// FNV-1a, so that the pool can look strings up without building a std::string
+struct string_ref_hash
+{
+    std::size_t operator()( const boost::string_ref value ) const
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for ( const char c : value )
+        {
+            hash ^= static_cast< unsigned char >( c );
+            hash *= 1099511628211ULL;
+        }
+
+        return static_cast< std::size_t >( hash );
+    }
+};
+
+} // ns details
+
+/**@struct string_pool
+ * @brief Stores every distinct string once
+ *
+ * Processes of worker pools or containers share the same command line, name
+ * and version. Once interned in a pool, equal strings share one allocation,
+ * and comparing them is a pointer comparison, see shared_string::same_storage().
+ *
+ * Keeping one pool across consecutive captures makes the strings of a process
+ * which keeps running cost nothing after the first capture. Strings are kept as
+ * long as the pool exists, call purge() from time to time to drop those of
+ * processes which exited.
+ *
+ * A pool is not thread-safe. */
+struct string_pool : boost::noncopyable
+{
+    /**@brief Returns the pooled copy of a string
+     *
+     * Empty strings are not stored. */
+    details::shared_string intern( const boost::string_ref value )
+    {
+        if ( value.empty() )
+            return details::shared_string();
+
+        const auto found = m_strings.find( value );
+        if ( found != m_strings.end() )
+            return details::shared_string( found->second );
+
+        const std::shared_ptr< const std::string > pooled =
+            std::make_shared< const std::string >( value.begin(), value.end() );
+
+        // the key points into the pooled string, which never moves
+        m_strings.insert( std::make_pair( boost::string_ref( *pooled ), pooled ) );
+        return details::shared_string( pooled );
+    }
+
+    details::shared_string intern( const details::shared_string & value )
+    {
+        return intern( boost::string_ref( value.str() ) );
+    }
+
+    /**@brief Returns the number of distinct strings in the pool */
+    std::size_t size() const
+    {
+        return m_strings.size();
+    }
+
+    /**@brief Drops the strings which are only held by the pool
+     * @return The number of strings dropped */
+    std::size_t purge()
+    {
+        std::size_t dropped = 0;
+        for ( auto entry = m_strings.begin(); entry != m_strings.end(); )
+        {
+            if ( entry->second.use_count() == 1 )
+            {
+                entry = m_strings.erase( entry );
+                ++dropped;
+            }
+            else
+            {
+                ++entry;
+            }
+        }
+
+        return dropped;
+    }
+
+    void clear()
+    {
+        m_strings.clear();
+    }
+
+private:
+    std::unordered_map< boost::string_ref,
+                        std::shared_ptr< const std::string >,
+                        details::string_ref_hash > m_strings;
+};
+
+} // namespace ps
+
+#endif // PS_STRING_POOL_H
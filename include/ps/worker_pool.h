@@ -0,0 +1,167 @@
+#ifndef PS_WORKER_POOL_H
+#define PS_WORKER_POOL_H
+
+#include "config.h"
+#include "ps/common.h"
+
+namespace ps
+{
+
+/**@brief How the files of /proc are read during a capture */
+enum read_backend
+{
+    READ_SYNCHRONOUS = 0x0, ///< one open, read and close syscall per file
+    READ_IO_URING    = 0x1  ///< batches of files per io_uring syscall, when available
+};
+
+/**@struct parallel_options
+ * @brief Tells a capture how many threads it may use, and how they read files */
+struct parallel_options
+{
+    /**@param[in] threads The number of worker threads. 0 means one per core
+     * @param[in] backend How every thread reads the files of /proc */
+    explicit
+    parallel_options( unsigned threads = 0,
+                      read_backend backend = READ_SYNCHRONOUS )
+        : threads( threads )
+        , backend( backend )
+    {
+    }
+
+    /**@brief Returns the number of threads actually used, never 0 */
+    unsigned thread_count() const
+    {
+#if HAVE_THREAD
+        if ( threads == 0 )
+            return std::max( 1u, std::thread::hardware_concurrency() );
+#endif
+        return std::max( 1u, threads );
+    }
+
+    unsigned     threads;
+    read_backend backend;
+};
+
+namespace details
+{
+
+#if HAVE_THREAD && HAVE_MUTEX
+// A contiguous range of indices owned by one worker.
+// The owner takes chunks from the front, thieves take halves from the back.
+struct work_shard
+{
+    work_shard()
+        : m_begin( 0 )
+        , m_end( 0 )
+    {
+    }
+
+    void assign( std::size_t begin, std::size_t end )
+    {
+        std::lock_guard< std::mutex > lock( m_mutex );
+        m_begin = begin;
+        m_end = end;
+    }
+
+    bool pop_front( std::size_t chunk, std::size_t & begin, std::size_t & end )
+    {
+        std::lock_guard< std::mutex > lock( m_mutex );
+        if ( m_begin == m_end )
+            return false;
+
+        begin = m_begin;
+        end = std::min( m_end, m_begin + chunk );
+        m_begin = end;
+        return true;
+    }
+
+    bool steal_back( std::size_t & begin, std::size_t & end )
+    {
+        std::lock_guard< std::mutex > lock( m_mutex );
+        if ( m_begin == m_end )
+            return false;
+
+        const std::size_t half = ( m_end - m_begin + 1 ) / 2;
+        end = m_end;
+        begin = m_end - half;
+        m_end = begin;
+        return true;
+    }
+
+private:
+    std::mutex  m_mutex;
+    std::size_t m_begin;
+    std::size_t m_end;
+};
+#endif
+
+/**@brief Calls task( i ) for every i in [0, count) over a work-stealing pool
+ *
+ * The range is split into one shard per thread. Each worker consumes its
+ * own shard in small chunks, then steals half of whatever is left in the
+ * other shards, so that slow processes do not leave threads idle.
+ * The calling thread takes part in the work. */
+template< typename Task >
+void parallel_for( const std::size_t count, const parallel_options & options,
+                   Task task )
+{
+#if HAVE_THREAD && HAVE_MUTEX
+    const std::size_t threads =
+        std::min< std::size_t >( options.thread_count(), count );
+
+    if ( threads <= 1 )
+    {
+        for ( std::size_t i = 0; i < count; ++i )
+            task( i );
+        return;
+    }
+
+    std::vector< work_shard > shards( threads );
+    for ( std::size_t i = 0; i < threads; ++i )
+        shards[i].assign( count * i / threads, count * ( i + 1 ) / threads );
+
+    const std::size_t chunk = 16;
+    auto worker = [&]( const std::size_t self )
+    {
+        std::size_t begin, end;
+        for ( ;; )
+        {
+            if ( !shards[self].pop_front( chunk, begin, end ) )
+            {
+                bool stolen = false;
+                for ( std::size_t i = 1; i < threads && !stolen; ++i )
+                    stolen = shards[( self + i ) % threads].steal_back( begin, end );
+
+                if ( !stolen )
+                    return;
+
+                // keep the stolen work in our own shard, so it can be stolen again
+                shards[self].assign( begin, end );
+                continue;
+            }
+
+            for ( ; begin != end; ++begin )
+                task( begin );
+        }
+    };
+
+    std::vector< std::thread > pool;
+    pool.reserve( threads - 1 );
+    for ( std::size_t i = 1; i < threads; ++i )
+        pool.emplace_back( worker, i );
+
+    worker( 0 );
+
+    for ( std::thread & thread : pool )
+        thread.join();
+#else
+    ( void )options;
+    for ( std::size_t i = 0; i < count; ++i )
+        task( i );
+#endif
+}
+
+} // ns details
+} // namespace ps
+
+#endif // PS_WORKER_POOL_H
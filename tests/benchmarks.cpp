@@ -0,0 +1,512 @@
+#include <chrono>
+#include <iostream>
+#include <sstream>
+
+#include "config.h"
+#include "ps/process.h"
+#include "ps/snapshot.h"
+#include "ps/snapshot_file.h"
+#include "ps/snapshot_index.h"
+#include "ps/pid_set.h"
+#include "ps/cpu_sampler.h"
+#include "ps/memory_accounting.h"
+#include "ps/io_sampler.h"
+#include "ps/history.h"
+
+#define LAUNCH_BENCHMARK( X ) \
+    launch_benchmark( X, #X )
+
+static void
+launch_benchmark( void( * benchmark_function )(), std::string name )
+{
+    std::cout << name << ":\n";
+    benchmark_function();
+}
+
+// returns the average duration of a call to function, in microseconds
+template< typename Function >
+double measure( Function function, const unsigned iterations = 10 )
+{
+    typedef std::chrono::steady_clock clock;
+
+    function(); // warm up the caches
+    const auto start = clock::now();
+    for ( unsigned i = 0; i < iterations; ++i )
+        function();
+    const auto elapsed = clock::now() - start;
+
+    return std::chrono::duration< double, std::micro >( elapsed ).count() / iterations;
+}
+
+void benchmark_parallel_capture()
+{
+    std::size_t processes = 0;
+    const double serial = measure( [&]()
+    {
+        processes = ps::capture( ps::ENUMERATE_BSD_APPS ).size();
+    } );
+
+    std::cout << "  " << processes << " processes\n";
+    std::cout << "  threads: 1, " << serial << " us\n";
+
+    const unsigned cores = ps::parallel_options().thread_count();
+    for ( unsigned threads = 2; threads <= 2 * cores; threads *= 2 )
+    {
+        const double parallel = measure( [&]()
+        {
+            ps::capture( ps::ENUMERATE_BSD_APPS, ps::parallel_options( threads ) );
+        } );
+
+        std::cout << "  threads: " << threads << ", " << parallel << " us"
+                  << ", speedup: " << serial / parallel << "\n";
+    }
+}
+
+void benchmark_io_uring_reads()
+{
+    const std::vector< pid_t > pids = ps::get_pids_from_procfs();
+    std::vector< std::string > cmdlines( pids.size() );
+    std::vector< char > found( pids.size() );
+
+    const double synchronous = measure( [&]()
+    {
+        ps::details::read_procfs_files( pids.data(), pids.size(), "cmdline",
+                                        cmdlines.data(), found.data(), false );
+    } );
+
+    // the synchronous path costs an open, a read until end of file and a close per file
+    std::cout << "  " << pids.size() << " files\n";
+    std::cout << "  synchronous: " << synchronous << " us"
+              << ", at least " << 3 * pids.size() << " syscalls\n";
+
+    if ( !ps::has_io_uring() )
+    {
+        std::cout << "  io_uring: unavailable\n";
+        return;
+    }
+
+    unsigned syscalls = 0;
+    const double batched = measure( [&]()
+    {
+        syscalls = ps::details::read_procfs_files( pids.data(), pids.size(), "cmdline",
+                                                   cmdlines.data(), found.data(), true );
+    } );
+
+    std::cout << "  io_uring: " << batched << " us"
+              << ", " << syscalls << " syscalls"
+              << ", speedup: " << synchronous / batched << "\n";
+}
+
+void benchmark_parse_process_stat()
+{
+    // the stat lines of the running processes, parsed over and over
+    std::vector< std::string > lines;
+    for ( const pid_t pid : ps::get_pids_from_procfs() )
+    {
+        std::string line;
+        if ( ps::details::read_procfs_file( pid, "stat", line ) )
+            lines.push_back( line );
+    }
+
+    if ( lines.empty() )
+        return;
+
+    const std::size_t parses = 200000;
+    unsigned long long checksum = 0;
+    const double hand_written = measure( [&]()
+    {
+        ps::process_stat stat;
+        for ( std::size_t i = 0; i < parses; ++i )
+        {
+            const std::string & line = lines[i % lines.size()];
+            ps::details::parse_process_stat( line.data(), line.size(), stat );
+            checksum += stat.utime;
+        }
+    }, 1 );
+
+    const double with_istringstream = measure( [&]()
+    {
+        ps::process_stat stat;
+        for ( std::size_t i = 0; i < parses; ++i )
+        {
+            const std::string & line = lines[i % lines.size()];
+            std::istringstream fields( line.substr( line.rfind( ')' ) + 2 ) );
+
+            long long skipped;
+            fields >> stat.state >> stat.ppid >> stat.pgrp >> stat.session;
+            for ( int field = 7; field < 14; ++field )
+                fields >> skipped;
+            fields >> stat.utime >> stat.stime;
+            for ( int field = 16; field < 20; ++field )
+                fields >> skipped;
+            fields >> stat.threads >> skipped >> stat.start_time >> stat.vsize >> stat.rss;
+            checksum += stat.utime;
+        }
+    }, 1 );
+
+    std::cout << "  " << parses << " stat lines" << ( checksum ? "" : " " ) << "\n";
+    std::cout << "  hand-written: " << hand_written * 1000 / parses << " ns per line, "
+              << static_cast< unsigned long >( parses / ( hand_written / 1e6 ) ) << " lines per second\n";
+    std::cout << "  istringstream: " << with_istringstream * 1000 / parses << " ns per line"
+              << ", speedup: " << with_istringstream / hand_written << "\n";
+}
+
+void benchmark_process_memory()
+{
+    const std::vector< pid_t > pids = ps::get_pids_from_procfs();
+    if ( pids.empty() )
+        return;
+
+    ps::process_memory memory;
+    const double statm = measure( [&]()
+    {
+        for ( const pid_t pid : pids )
+            ps::details::read_process_memory( pid, memory, false );
+    }, 100 );
+
+    const double status = measure( [&]()
+    {
+        for ( const pid_t pid : pids )
+            ps::details::read_process_memory( pid, memory, true );
+    }, 100 );
+
+#if PS_HAVE_PROCFS
+    // the files are opened by the first round, and read with pread afterwards
+    ps::memory_reader reader( pids.size() );
+    const double reused = measure( [&]()
+    {
+        for ( const pid_t pid : pids )
+            reader.read( pid, memory );
+
+        reader.sweep();
+    }, 100 );
+#endif
+
+    std::cout << "  " << pids.size() << " processes\n";
+    std::cout << "  statm: " << statm / pids.size() << " us per process\n";
+#if PS_HAVE_PROCFS
+    std::cout << "  statm, files kept open: " << reused / pids.size() << " us per process\n";
+#endif
+    std::cout << "  statm and status: " << status / pids.size() << " us per process\n";
+}
+
+void benchmark_capture_fields()
+{
+    const struct
+    {
+        const char * name;
+        ps::fields   wanted;
+    } selections[] =
+    {
+        { "pid",     ps::FIELD_PID },
+        { "name",    ps::FIELD_NAME },
+        { "cmdline", ps::FIELD_CMDLINE },
+        { "all",     ps::FIELD_ALL }
+    };
+
+    for ( const auto & selection : selections )
+    {
+        const double duration = measure( [&]()
+        {
+            ps::capture( ps::ENUMERATE_BSD_APPS, selection.wanted );
+        } );
+
+        std::cout << "  " << selection.name << ": " << duration << " us\n";
+    }
+}
+
+void benchmark_capture_into()
+{
+    ps::snapshot processes;
+    ps::capture_into( processes, ps::ENUMERATE_BSD_APPS );
+
+    const double fresh = measure( [&]()
+    {
+        processes = ps::capture( ps::ENUMERATE_BSD_APPS );
+    }, 100 );
+
+    const double recycled = measure( [&]()
+    {
+        ps::capture_into( processes, ps::ENUMERATE_BSD_APPS );
+    }, 100 );
+
+    std::cout << "  " << processes.size() << " processes\n";
+    std::cout << "  capture: " << fresh << " us\n";
+    std::cout << "  capture_into: " << recycled << " us"
+              << ", speedup: " << fresh / recycled << "\n";
+}
+
+// makes count processes out of the running ones, to benchmark as many
+// processes as a large server runs. Copies share the strings and the pids of
+// the processes they come from, unless distinct_pids is set: pids then go from
+// 1 to count, and every process has strings of its own
+ps::snapshot make_synthetic_snapshot( const std::size_t count, const bool distinct_pids )
+{
+    const ps::snapshot running =
+        ps::capture( ps::ENUMERATE_BSD_APPS, ps::FIELD_CMDLINE | ps::FIELD_NAME | ps::FIELD_STAT );
+
+    ps::snapshot processes;
+    processes.reserve( count );
+    for ( std::size_t i = 1; processes.size() < count && !running.empty(); ++i )
+    {
+        const ps::process & model = running[i % running.size()];
+        if ( distinct_pids )
+            processes.emplace_back( static_cast< pid_t >( i ), model.cmdline(), model.title(), model.name(),
+                                    model.version(), model.start_time() );
+        else
+            processes.push_back( model );
+    }
+
+    return processes;
+}
+
+void benchmark_find_if_by_name()
+{
+    const ps::snapshot processes = make_synthetic_snapshot( 50000, false );
+
+    const std::string missing = "no-such-process";
+    const double by_copy = measure( [&]()
+    {
+        // what comparing cost when the accessors returned copies
+        std::find_if( processes.begin(), processes.end(), [&]( const ps::process & p )
+        {
+            return std::string( p.name() ) == missing;
+        } );
+    } );
+
+    const double by_reference = measure( [&]()
+    {
+        std::find_if( processes.begin(), processes.end(), [&]( const ps::process & p )
+        {
+            return p.name() == missing;
+        } );
+    } );
+
+    const double copy = measure( [&]()
+    {
+        const ps::snapshot duplicate( processes );
+    } );
+
+    std::cout << "  " << processes.size() << " processes\n";
+    std::cout << "  find_if, copying names: " << by_copy << " us\n";
+    std::cout << "  find_if, by reference: " << by_reference << " us"
+              << ", speedup: " << by_copy / by_reference << "\n";
+    std::cout << "  snapshot copy: " << copy << " us\n";
+}
+
+void benchmark_snapshot_index()
+{
+    const ps::snapshot processes = make_synthetic_snapshot( 50000, true );
+
+    ps::snapshot_index index;
+    const double building = measure( [&]() { index.build( processes ); } );
+
+    // a few hundred lookups, as an alerting pass does after every capture
+    std::size_t found = 0;
+    const double by_find_if = measure( [&]()
+    {
+        for ( pid_t pid = 1; pid <= 300; ++pid )
+        {
+            const pid_t wanted = pid * 157;
+            found += std::find_if( processes.begin(), processes.end(), [&]( const ps::process & p )
+            {
+                return p.pid() == wanted;
+            } ) != processes.end();
+        }
+    } );
+
+    const double by_index = measure( [&]()
+    {
+        for ( pid_t pid = 1; pid <= 300; ++pid )
+            found += index.find_pid( pid * 157 ) != nullptr;
+    } );
+
+    const double by_name = measure( [&]()
+    {
+        for ( int i = 0; i < 300; ++i )
+            found += index.find_name( processes[i % processes.size()].name() ).size();
+    } );
+
+    std::cout << "  " << processes.size() << " processes, " << found << " found\n";
+    std::cout << "  build: " << building << " us\n";
+    std::cout << "  300 pids, find_if: " << by_find_if << " us\n";
+    std::cout << "  300 pids, index: " << by_index << " us"
+              << ", speedup: " << by_find_if / by_index << "\n";
+    std::cout << "  300 names, index: " << by_name << " us\n";
+}
+
+void benchmark_mapped_snapshot()
+{
+#if PS_HAVE_MAPPED_SNAPSHOT
+    // an archive as large as a busy server produces
+    const ps::snapshot processes = make_synthetic_snapshot( 500000, true );
+
+    const std::string path = "benchmark_snapshot.pssnap";
+    const double saving = measure( [&]() { ps::save( processes, path ); }, 1 );
+
+    const pid_t wanted = static_cast< pid_t >( processes.size() / 2 );
+    std::size_t found = 0;
+    const double lookup = measure( [&]()
+    {
+        const ps::mapped_snapshot mapped( path );
+        found = mapped.find_pid( wanted );
+    }, 100 );
+
+    remove( path.c_str() );
+
+    std::cout << "  " << processes.size() << " processes\n";
+    std::cout << "  save: " << saving << " us\n";
+    std::cout << "  open and find one pid: " << lookup << " us"
+              << ( found == ps::mapped_snapshot::npos ? " (not found)" : "" ) << "\n";
+#else
+    std::cout << "  mmap: unavailable\n";
+#endif
+}
+
+void benchmark_history()
+{
+#if PS_HAVE_HISTORY
+    // ten minutes of one capture per second, with a few processes coming and going
+    const ps::snapshot running = ps::capture( ps::ENUMERATE_BSD_APPS );
+    ps::history recorded( 600 );
+    ps::snapshot current( running );
+    std::size_t copies = 0;
+    const ps::history::clock::time_point start = ps::history::clock::now();
+
+    const double pushing = measure( [&]()
+    {
+        for ( int tick = 0; tick < 600; ++tick )
+        {
+            if ( !current.empty() )
+                current.pop_back();
+            current.emplace_back( 1000000 + tick, "/bin/sh -c true", "", "sh", "", tick );
+
+            recorded.push( current, start + std::chrono::seconds( tick ) );
+            for ( const ps::process & p : current )
+                copies += sizeof( p ) + p.cmdline().capacity() + p.name().capacity();
+        }
+    }, 1 );
+
+    const double seeking = measure( [&]()
+    {
+        recorded.at_time( start + std::chrono::seconds( 300 ), current );
+    }, 100 );
+
+    std::cout << "  " << running.size() << " processes, " << recorded.size() << " ticks\n";
+    std::cout << "  push: " << pushing / 600 << " us per tick\n";
+    std::cout << "  seek and restore: " << seeking << " us\n";
+    std::cout << "  memory: " << recorded.memory_usage() / 1024 << " KiB, "
+              << copies / 1024 << " KiB as full snapshots\n";
+#else
+    std::cout << "  history: unavailable\n";
+#endif
+}
+
+void benchmark_pid_set()
+{
+    // two sets the size of the largest pid_max linux accepts, as full as it allows
+    const std::size_t pid_max = 4194304;
+    ps::pid_set before( pid_max );
+    ps::pid_set after( pid_max );
+    for ( pid_t pid = 0; pid < static_cast< pid_t >( pid_max ); pid += 3 )
+        before.insert( pid );
+    for ( pid_t pid = 0; pid < static_cast< pid_t >( pid_max ); pid += 5 )
+        after.insert( pid );
+
+    std::size_t exited = 0;
+    const double diffing = measure( [&]()
+    {
+        exited = ( before - after ).count();
+    }, 100 );
+
+    ps::pid_set seen( pid_max );
+    const double merging = measure( [&]() { seen |= before; }, 100 );
+
+    std::cout << "  pid_max " << pid_max
+              << ( PS_HAVE_AVX2 ? ", avx2" : PS_HAVE_SSE2 ? ", sse2" : ", scalar" ) << "\n";
+    std::cout << "  difference and count: " << diffing << " us, " << exited << " pids\n";
+    std::cout << "  union in place: " << merging << " us\n";
+}
+
+void benchmark_cpu_sampler()
+{
+#if PS_HAVE_CPU_SAMPLER
+    ps::cpu_sampler sampler;
+    sampler.tick();
+
+    std::size_t processes = 0;
+    const double ticking = measure( [&]() { processes = sampler.tick().size(); }, 100 );
+
+    std::cout << "  " << processes << " processes\n";
+    std::cout << "  tick: " << ticking << " us, "
+              << ( processes ? ticking / processes : 0 ) << " us per process\n";
+#else
+    std::cout << "  cpu_sampler: unavailable\n";
+#endif
+}
+
+void benchmark_io_sampler()
+{
+#if PS_HAVE_IO_SAMPLER
+    ps::io_sampler sampler;
+    sampler.tick();
+
+    std::size_t processes = 0;
+    const double ticking = measure( [&]() { processes = sampler.tick().size(); }, 100 );
+
+    std::cout << "  " << processes << " processes, " << sampler.denied() << " denied\n";
+    std::cout << "  tick: " << ticking << " us, "
+              << ( processes ? ticking / processes : 0 ) << " us per process\n";
+#else
+    std::cout << "  io_sampler: unavailable\n";
+#endif
+}
+
+void benchmark_memory_accounting()
+{
+    const std::vector< pid_t > pids = ps::get_pids_from_procfs();
+    if ( pids.empty() )
+        return;
+
+    ps::memory_accounting accounting;
+    const double rollup = measure( [&]()
+    {
+        accounting = ps::account_memory( pids, ps::parallel_options( 1 ) );
+    } );
+
+    const double full = measure( [&]()
+    {
+        ps::account_memory( pids, ps::parallel_options( 1 ), ps::SMAPS_FULL );
+    } );
+
+    const double parallel = measure( [&]()
+    {
+        ps::account_memory( pids );
+    } );
+
+    std::cout << "  " << accounting.processes.size() << " processes read, "
+              << accounting.unreadable << " unreadable, " << accounting.rollups << " rollups\n";
+    std::cout << "  total pss " << accounting.total.pss / 1024 << " kB, uss "
+              << accounting.total.uss / 1024 << " kB, swap pss " << accounting.total.swap_pss / 1024 << " kB\n";
+    std::cout << "  smaps: " << full << " us, smaps_rollup: " << rollup << " us"
+              << ", speedup: " << full / rollup << "\n";
+    std::cout << "  smaps_rollup, one thread per core: " << parallel << " us\n";
+}
+
+int main()
+{
+    LAUNCH_BENCHMARK( benchmark_parallel_capture );
+    LAUNCH_BENCHMARK( benchmark_io_uring_reads );
+    LAUNCH_BENCHMARK( benchmark_capture_fields );
+    LAUNCH_BENCHMARK( benchmark_parse_process_stat );
+    LAUNCH_BENCHMARK( benchmark_process_memory );
+    LAUNCH_BENCHMARK( benchmark_capture_into );
+    LAUNCH_BENCHMARK( benchmark_find_if_by_name );
+    LAUNCH_BENCHMARK( benchmark_snapshot_index );
+    LAUNCH_BENCHMARK( benchmark_mapped_snapshot );
+    LAUNCH_BENCHMARK( benchmark_history );
+    LAUNCH_BENCHMARK( benchmark_pid_set );
+    LAUNCH_BENCHMARK( benchmark_cpu_sampler );
+    LAUNCH_BENCHMARK( benchmark_io_sampler );
+    LAUNCH_BENCHMARK( benchmark_memory_accounting );
+}
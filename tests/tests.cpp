@@ -1,16 +1,38 @@
 #include <boost/filesystem.hpp>
+#include <atomic>
+#include <cstdlib>
+#include <functional>
 #include <iostream>
+#include <new>
 
 #include "config.h"
 #include "ps/process.h"
 #include "ps/snapshot.h"
 #include "ps/cocoa.h"
 #include "ps/java.h"
+#include "ps/live_table.h"
+#include "ps/exit_watcher.h"
+#include "ps/snapshot_table.h"
+#include "ps/snapshot_file.h"
+#include "ps/history.h"
+#include "ps/snapshot_index.h"
+#include "ps/pid_set.h"
+#include "ps/cpu_sampler.h"
+#include "ps/memory_accounting.h"
+#include "ps/io_sampler.h"
 
 #if HAVE_SIGNAL_H
 #include <signal.h>
 #endif
 
+#if HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
+
+#if HAVE_SCHED_H
+#include <sched.h>
+#endif
+
 #if HAVE_WINNT_H
 #include <winnt.h>
 #endif
@@ -18,6 +40,40 @@
 #define LAUNCH_TEST( X ) \
     launch_test( X, #X )
 
+// counts the heap allocations of the whole program
+static std::atomic< unsigned long > allocations( 0 );
+
+// the replacements are kept out of line: once inlined, gcc sees free() called on
+// what operator new returned, and warns about a mismatched deallocation
+#if defined( __GNUC__ )
+#   define TEST_NOINLINE __attribute__( ( noinline ) )
+#else
+#   define TEST_NOINLINE
+#endif
+
+TEST_NOINLINE
+void * operator new( std::size_t size )
+{
+    ++allocations;
+    void * const memory = std::malloc( size ? size : 1 );
+    if ( memory == nullptr )
+        throw std::bad_alloc();
+
+    return memory;
+}
+
+TEST_NOINLINE
+void operator delete( void * memory ) noexcept
+{
+    std::free( memory );
+}
+
+TEST_NOINLINE
+void operator delete( void * memory, std::size_t ) noexcept
+{
+    std::free( memory );
+}
+
 static std::string own_name;
 static std::string argv_java_minecraft="/System/Library/Java/JavaVirtualMachines/1.6.0.jdk/Contents/Home/bin/java -Xdock:icon=/Users/sdomingues/Library/Application Support/minecraft/assets/objects/99/991b421dfd401f115241601b2b373140a8d78572 -Xdock:name=Minecraft -Xmx1G -XX:+UseConcMarkSweepGC -XX:+CMSIncrementalMode -XX:-UseAdaptiveSizePolicy -Xmn128M -Djava.library.path=/Users/sdomingues/Library/Application Support/minecraft/versions/1.7.10/1.7.10-natives-1407418625799030000 -cp /Users/sdomingues/Library/Application Support/minecraft/libraries/com/mojang/realms/1.3.3/realms-1.3.3.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/org/apache/commons/commons-compress/1.8.1/commons-compress-1.8.1.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/org/apache/httpcomponents/httpclient/4.3.3/httpclient-4.3.3.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/commons-logging/commons-logging/1.1.3/commons-logging-1.1.3.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/org/apache/httpcomponents/httpcore/4.3.2/httpcore-4.3.2.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/java3d/vecmath/1.3.1/vecmath-1.3.1.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/net/sf/trove4j/trove4j/3.0.3/trove4j-3.0.3.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/com/ibm/icu/icu4j-core-mojang/51.2/icu4j-core-mojang-51.2.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/net/sf/jopt-simple/jopt-simple/4.5/jopt-simple-4.5.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/com/paulscode/codecjorbis/20101023/codecjorbis-20101023.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/com/paulscode/codecwav/20101023/codecwav-20101023.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/com/paulscode/libraryjavasound/20101123/libraryjavasound-20101123.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/com/paulscode/librarylwjglopenal/20100824/librarylwjglopenal-20100824.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/com/paulscode/soundsystem/20120107/soundsystem-20120107.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/io/netty/netty-all/4.0.10.Final/netty-all-4.0.10.Final.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/com/google/guava/guava/15.0/guava-15.0.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/org/apache/commons/commons-lang3/3.1/commons-lang3-3.1.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/commons-io/commons-io/2.4/commons-io-2.4.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/commons-codec/commons-codec/1.9/commons-codec-1.9.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/net/java/jinput/jinput/2.0.5/jinput-2.0.5.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/net/java/jutils/jutils/1.0.0/jutils-1.0.0.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/com/google/code/gson/gson/2.2.4/gson-2.2.4.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/com/mojang/authlib/1.5.16/authlib-1.5.16.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/org/apache/logging/log4j/log4j-api/2.0-beta9/log4j-api-2.0-beta9.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/org/apache/logging/log4j/log4j-core/2.0-beta9/log4j-core-2.0-beta9.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/org/lwjgl/lwjgl/lwjgl/2.9.1/lwjgl-2.9.1.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/org/lwjgl/lwjgl/lwjgl_util/2.9.1/lwjgl_util-2.9.1.jar:/Users/sdomingues/Library/Application Support/minecraft/libraries/tv/twitch/twitch/5.16/twitch-5.16.jar:/Users/sdomingues/Library/Application Support/minecraft/versions/1.7.10/1.7.10.jar net.minecraft.client.main.Main --username Player --version 1.7.10 --gameDir /Users/sdomingues/Library/Application Support/minecraft --assetsDir /Users/sdomingues/Library/Application Support/minecraft/assets --assetIndex 1.7.10 --uuid 00000000-0000-0000-0000-000000000000 --accessToken 83b2f48ee15640ee82f0428636f2207c --userProperties {} --userType legacy --demo";
 
@@ -233,6 +289,13 @@ bool test_hard_kill()
     return false;
 }
 
+// an invalid pid gets an invalid process, without tripping the assertions of its accessors
+bool test_invalid_process_with_title()
+{
+    const ps::process invalid( ps::INVALID_PID, ps::FIELD_TITLE );
+    return !invalid.valid();
+}
+
 bool test_foreground_process()
 {
     return ps::get_application_in_foreground().valid();
@@ -266,6 +329,1408 @@ bool test_get_argv_from_pid()
     return true;
 }
 
+bool test_get_cmdline_from_pid()
+{
+    using boost::filesystem::path;
+
+    const std::string cmdline = ps::get_cmdline_from_pid( getpid() );
+    if ( cmdline.empty() )
+        return false;
+
+    if ( !ps::get_cmdline_from_pid( ps::INVALID_PID ).empty() )
+        return false;
+
+    return equivalent( path( cmdline ), path( own_name ) )
+        && equivalent( path( ps::get_executable_from_pid( getpid() ) ), path( own_name ) );
+}
+
+bool test_get_cmdlines_from_pids()
+{
+    const std::vector< pid_t > pids = { getpid(), ps::INVALID_PID, getpid() };
+    const auto cmdlines = ps::get_cmdlines_from_pids( pids );
+
+    if ( cmdlines.size() != pids.size() )
+        return false;
+
+    return !cmdlines[0].empty()
+        && cmdlines[1].empty()
+        && cmdlines[0] == cmdlines[2]
+        && cmdlines[0] == ps::get_cmdline_from_pid( getpid() );
+}
+
+bool test_procfs_directory()
+{
+#if PS_HAVE_PROCFS
+    ps::details::procfs_directory proc;
+    if ( !proc.is_open() )
+        return false;
+
+    // scan twice, to make sure the directory can be reused
+    std::vector< pid_t > pids;
+    if ( !proc.read_pids( pids ) || !proc.read_pids( pids ) )
+        return false;
+
+    if ( std::count( pids.begin(), pids.end(), getpid() ) != 2 )
+        return false;
+
+    // each scan needs one call per batch of entries, plus one to reach the end
+    return proc.syscalls() <= 2 * ( 2 + pids.size() / 1000 );
+#else
+    return true;
+#endif
+}
+
+bool test_parse_pid()
+{
+    pid_t pid = ps::INVALID_PID;
+    using ps::details::parse_pid;
+
+    return parse_pid( "12113", pid ) && pid == 12113
+        && !parse_pid( "self", pid )
+        && !parse_pid( "dri", pid )
+        && !parse_pid( "12a", pid )
+        && !parse_pid( "", pid )
+        && !parse_pid( "0", pid )
+        && pid == 12113;
+}
+
+bool test_parallel_capture()
+{
+    using boost::filesystem::path;
+
+    const ps::snapshot all_processes =
+        ps::capture( ps::ENUMERATE_BSD_APPS, ps::parallel_options( 4 ) );
+
+    // the pid order must not depend on the way the work was shared
+    for ( std::size_t i = 1; i < all_processes.size(); ++i )
+    {
+        if ( all_processes[i - 1].pid() >= all_processes[i].pid() )
+            return false;
+    }
+
+    const auto myself = std::find_if(
+        all_processes.cbegin(),
+        all_processes.cend(),
+        []( const ps::process & p ) {
+            return p.pid() == getpid();
+        }
+    );
+
+    return myself != all_processes.cend()
+        && equivalent( path( myself->cmdline() ), path( own_name ) );
+}
+
+bool test_io_uring_capture()
+{
+    // io_uring may be unavailable, in which case the synchronous path is used
+    const ps::snapshot synchronous =
+        ps::capture( ps::ENUMERATE_BSD_APPS, ps::parallel_options( 1 ) );
+    const ps::snapshot batched =
+        ps::capture( ps::ENUMERATE_BSD_APPS, ps::parallel_options( 1, ps::READ_IO_URING ) );
+
+    const auto find_myself = []( const ps::snapshot & processes )
+    {
+        return std::find_if(
+            processes.cbegin(),
+            processes.cend(),
+            []( const ps::process & p ) {
+                return p.pid() == getpid();
+            }
+        );
+    };
+
+    const auto myself = find_myself( batched );
+    if ( myself == batched.cend() || find_myself( synchronous ) == synchronous.cend() )
+        return false;
+
+    return myself->cmdline() == find_myself( synchronous )->cmdline();
+}
+
+// a command line longer than one ring read is completed synchronously, after what the ring read
+bool test_io_uring_reads_long_cmdline()
+{
+#if HAVE_EXECVE && HAVE_FORK
+    std::string argument( 10000, 'x' );
+    for ( std::size_t i = 0; i < argument.size(); i += 100 )
+        argument[i] = static_cast< char >( 'a' + i / 100 % 26 );
+
+    const pid_t pid = fork();
+    if ( pid == 0 )
+    {
+        // the shell keeps its arguments while it waits for sleep
+        char * const argv[] = { ( char * )"/bin/sh", ( char * )"-c", ( char * )"sleep 5; :",
+                                ( char * )"sh", &argument[0], NULL };
+        execve( "/bin/sh", argv, nullptr );
+        _exit( 1 );
+    }
+
+    std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+
+    std::string synchronous, batched;
+    char found_synchronous = 0, found_batched = 0;
+    ps::details::read_procfs_files( &pid, 1, "cmdline", &synchronous, &found_synchronous, false );
+    ps::details::read_procfs_files( &pid, 1, "cmdline", &batched, &found_batched, true );
+
+    ps::process( pid ).kill( false );
+    waitpid( pid, nullptr, 0 );
+
+    const std::string expected = std::string( "/bin/sh\0-c\0sleep 5; :\0sh\0", 25 ) + argument + '\0';
+    return found_synchronous && found_batched && synchronous == expected && batched == expected;
+#else
+    return true;
+#endif
+}
+
+bool test_read_procfs_file_does_not_allocate()
+{
+    std::string cmdline;
+    cmdline.reserve( ps::PROCFS_READ_LIMIT );
+
+    // the first read sets up the per-thread buffers and the /proc descriptor
+    if ( !ps::details::read_procfs_file( getpid(), "cmdline", cmdline ) )
+        return false;
+
+    const unsigned long before = allocations;
+    for ( unsigned i = 0; i < 100; ++i )
+    {
+        if ( !ps::details::read_procfs_file( getpid(), "cmdline", cmdline ) )
+            return false;
+    }
+
+    return allocations == before;
+}
+
+bool test_read_procfs_file_truncates()
+{
+    std::string cmdline;
+    if ( !ps::details::read_procfs_file( getpid(), "cmdline", cmdline, 4 ) )
+        return false;
+
+    return cmdline.size() == 4
+        && ps::get_cmdline_from_pid( getpid() ).compare( 0, 4, cmdline ) == 0;
+}
+
+bool test_capture_allocations()
+{
+    ps::capture( ps::ENUMERATE_BSD_APPS );
+
+    // beyond the attributes of every process and their strings, a capture
+    // only allocates a few containers
+    const unsigned long before = allocations;
+    const ps::snapshot all_processes = ps::capture( ps::ENUMERATE_BSD_APPS );
+    const unsigned long during = allocations - before;
+
+    if ( during > 2 * all_processes.size() + 64 )
+        return false;
+
+#if PS_HAVE_PROCFS
+    // with the pids alone, nothing depends on the number of processes: the
+    // pids, which of them were found, and the snapshot
+    ps::capture( ps::ENUMERATE_BSD_APPS, ps::FIELD_PID );
+    const unsigned long pids_before = allocations;
+    const ps::snapshot pids = ps::capture( ps::ENUMERATE_BSD_APPS, ps::FIELD_PID );
+    const unsigned long pids_during = allocations - pids_before;
+
+    return !pids.empty() && pids_during == 3;
+#else
+    return true;
+#endif
+}
+
+bool test_parse_stat_identity()
+{
+    // comm may contain spaces and parentheses
+    const std::string stat =
+        "4242 (a) (b c) S 1 4242 4242 0 -1 4194560 100 0 0 0 1 2 0 0 20 0 1 0 "
+        "123456 1000 10 18446744073709551615";
+
+    ps::details::stat_identity identity;
+    if ( !ps::details::parse_stat_identity( stat.data(), stat.size(), identity ) )
+        return false;
+
+    return identity.comm == "a) (b c"
+        && identity.start_time == 123456
+        && !ps::details::parse_stat_identity( "4242 (a", 7, identity );
+}
+
+bool test_parse_process_stat()
+{
+    // comm may contain spaces and parentheses
+    const std::string stat =
+        "4242 (a) (b c) S 1 4242 4241 0 -1 4194560 100 0 0 0 17 23 0 0 20 0 3 0 "
+        "123456 1000 10 18446744073709551615";
+
+    ps::process_stat parsed;
+    if ( !ps::details::parse_process_stat( stat.data(), stat.size(), parsed ) )
+        return false;
+
+    if ( parsed.state != 'S' || parsed.ppid != 1 || parsed.pgrp != 4242 || parsed.session != 4241 ||
+         parsed.utime != 17 || parsed.stime != 23 || parsed.threads != 3 ||
+         parsed.start_time != 123456 || parsed.vsize != 1000 || parsed.rss != 10 )
+        return false;
+
+    // truncated lines are refused
+    if ( ps::details::parse_process_stat( stat.data(), 40, parsed ) ||
+         ps::details::parse_process_stat( "4242 (a", 7, parsed ) )
+        return false;
+
+    // the stat of the running process is captured along with it, when asked for
+    const ps::process myself( getpid(), ps::FIELD_STAT );
+    return myself.stat().state == 'R' && myself.stat().ppid == getppid() &&
+           myself.stat().threads >= 1 && myself.stat().start_time == myself.start_time() &&
+           myself.stat().rss > 0 && ps::process( getpid(), ps::FIELD_NAME ).stat().state == 0 &&
+           ps::process( getpid() ).stat().state == 0;
+}
+
+// the reader keeps the statm files open, and closes those of the processes it stopped reading
+bool test_memory_reader()
+{
+#if PS_HAVE_PROCFS && HAVE_FORK
+    ps::memory_reader reader;
+    ps::process_memory memory;
+    if ( !reader.read( getpid(), memory ) || memory.resident == 0 || reader.open_files() != 1 )
+        return false;
+
+    // read again through the open file
+    const unsigned long long size = memory.size;
+    memory = ps::process_memory();
+    if ( !reader.read( getpid(), memory, true ) || memory.size == 0 || memory.peak_resident == 0 ||
+         reader.open_files() != 1 || size == 0 )
+        return false;
+
+    const pid_t pid = fork();
+    if ( pid == 0 )
+    {
+        pause();
+        _exit( 0 );
+    }
+
+    const bool child_read = reader.read( pid, memory ) && reader.open_files() == 2;
+    ps::process( pid ).kill( false );
+    waitpid( pid, nullptr, 0 );
+
+    // the file of a reaped process cannot be read anymore, and is closed
+    const bool child_gone = !reader.read( pid, memory ) && reader.open_files() == 1;
+
+    reader.sweep();
+    const bool kept = reader.open_files() == 1;
+    reader.sweep();
+    return child_read && child_gone && kept && reader.open_files() == 0;
+#else
+    return true;
+#endif
+}
+
+bool test_process_memory()
+{
+    const std::string statm = "2000 300 100 50 0 700 0\n";
+    const std::string status =
+        "Name:\tcat\nVmPeak:\t    8000 kB\nVmSize:\t    8000 kB\nVmHWM:\t    1300 kB\n"
+        "VmRSS:\t    1200 kB\nVmSwap:\t      12 kB\nThreads:\t1\n";
+
+    const unsigned long long page = ps::details::page_size();
+    ps::process_memory memory;
+    if ( !ps::details::parse_statm( statm.data(), statm.size(), memory ) ||
+         !ps::details::parse_status_memory( status.data(), status.size(), memory ) ||
+         ps::details::parse_statm( "2000 300", 8, memory ) )
+        return false;
+
+    if ( memory.size != 2000 * page || memory.resident != 300 * page || memory.shared != 100 * page ||
+         memory.text != 50 * page || memory.data != 700 * page ||
+         memory.peak_size != 8000 * 1024 || memory.peak_resident != 1300 * 1024 || memory.swap != 12 * 1024 )
+        return false;
+
+    // statm is read on its own, status only when asked for
+    const ps::snapshot cheap = ps::capture( ps::ENUMERATE_BSD_APPS, ps::FIELD_MEMORY );
+    const ps::snapshot full = ps::capture( ps::ENUMERATE_BSD_APPS, ps::FIELD_MEMORY_STATUS );
+    const ps::snapshot none = ps::capture( ps::ENUMERATE_BSD_APPS, ps::FIELD_PID );
+    const auto is_myself = []( const ps::process & p ) { return p.pid() == getpid(); };
+    const auto cheap_myself = std::find_if( cheap.begin(), cheap.end(), is_myself );
+    const auto full_myself = std::find_if( full.begin(), full.end(), is_myself );
+    const auto none_myself = std::find_if( none.begin(), none.end(), is_myself );
+    if ( cheap_myself == cheap.end() || full_myself == full.end() || none_myself == none.end() )
+        return false;
+
+    return cheap_myself->memory().resident > 0 && cheap_myself->memory().peak_resident == 0 &&
+           full_myself->memory().resident > 0 && full_myself->memory().peak_resident > 0 &&
+           none_myself->memory().size == 0 &&
+           ps::process( getpid(), ps::FIELD_MEMORY ).memory().size > 0;
+}
+
+bool test_process_io()
+{
+    const std::string io =
+        "rchar: 323934931\nwchar: 323929600\nsyscr: 632687\nsyscw: 632675\n"
+        "read_bytes: 4096\nwrite_bytes: 323932160\ncancelled_write_bytes: 8192\n";
+
+    ps::process_io counters;
+    if ( !ps::details::parse_process_io( io.data(), io.size(), counters ) ||
+         ps::details::parse_process_io( "Name: cat\n", 10, counters ) )
+        return false;
+
+    if ( !ps::details::parse_process_io( io.data(), io.size(), counters ) ||
+         counters.rchar != 323934931 || counters.wchar != 323929600 || counters.syscr != 632687 ||
+         counters.syscw != 632675 || counters.read_bytes != 4096 || counters.write_bytes != 323932160 ||
+         counters.cancelled_write_bytes != 8192 )
+        return false;
+
+#if PS_HAVE_PROCFS
+    // we read at least our own executable
+    const ps::snapshot processes = ps::capture( ps::ENUMERATE_BSD_APPS, ps::FIELD_IO );
+    const auto myself = std::find_if( processes.begin(), processes.end(), []( const ps::process & p )
+    {
+        return p.pid() == getpid();
+    } );
+
+    return myself != processes.end() && myself->io().rchar > 0 &&
+           ps::process( getpid(), ps::FIELD_IO ).io().syscr > 0 &&
+           ps::process( getpid(), ps::FIELD_PID ).io().syscr == 0;
+#else
+    return true;
+#endif
+}
+
+bool test_capture_delta()
+{
+#if HAVE_EXECVE && HAVE_SLEEP && HAVE_FORK
+    const ps::snapshot_delta first = ps::capture_delta( ps::snapshot() );
+    if ( first.current.empty() || first.added.size() != first.current.size() )
+        return false;
+
+    const pid_t pid = fork();
+    if ( pid == 0 )
+    {
+        char * const argv[] = { ( char * )"/usr/bin/sleep", ( char * )"5", NULL };
+        execve( "/usr/bin/sleep", argv, nullptr );
+        _exit( 1 );
+    }
+
+    sleep( 1 );
+    const ps::snapshot_delta second = ps::capture_delta( first.current );
+    ps::process( pid ).kill( false );
+    waitpid( pid, nullptr, 0 );
+
+    const ps::snapshot_delta third = ps::capture_delta( second.current );
+
+    const auto has_child = [pid]( const ps::snapshot & processes )
+    {
+        return std::find_if(
+            processes.cbegin(),
+            processes.cend(),
+            [pid]( const ps::process & p ) {
+                return p.pid() == pid;
+            }
+        ) != processes.cend();
+    };
+
+    // we are still the same process, so we must have been carried over
+    const auto myself = std::find_if(
+        second.current.cbegin(),
+        second.current.cend(),
+        []( const ps::process & p ) {
+            return p.pid() == getpid();
+        }
+    );
+
+    return has_child( second.added )
+        && !has_child( first.current )
+        && has_child( third.exited )
+        && !has_child( third.current )
+        && myself != second.current.cend()
+        && myself->start_time() != 0
+        && !has_child( second.exited );
+#else
+    return true;
+#endif
+}
+
+bool test_live_table()
+{
+#if PS_HAVE_LIVE_TABLE && HAVE_EXECVE && HAVE_FORK
+    ps::live_table table( std::chrono::milliseconds( 100 ) );
+
+    const auto contains = [&table]( const pid_t pid )
+    {
+        const ps::snapshot processes = table.view();
+        return std::find_if(
+            processes.cbegin(),
+            processes.cend(),
+            [pid]( const ps::process & p ) {
+                return p.pid() == pid;
+            }
+        ) != processes.cend();
+    };
+
+    // waits up to two seconds for the table to reflect a change
+    const auto eventually = []( const std::function< bool() > & condition )
+    {
+        for ( unsigned i = 0; i < 200; ++i )
+        {
+            if ( condition() )
+                return true;
+            usleep( 10000 );
+        }
+        return false;
+    };
+
+    if ( !contains( getpid() ) )
+        return false;
+
+    const pid_t pid = fork();
+    if ( pid == 0 )
+    {
+        char * const argv[] = { ( char * )"/usr/bin/sleep", ( char * )"5", NULL };
+        execve( "/usr/bin/sleep", argv, nullptr );
+        _exit( 1 );
+    }
+
+    const bool seen_start = eventually( [&]() { return contains( pid ); } );
+    kill( pid, SIGKILL );
+    waitpid( pid, nullptr, 0 );
+    const bool seen_exit = eventually( [&]() { return !contains( pid ); } );
+
+    return seen_start && seen_exit && table.stats().events >= 2;
+#else
+    return true;
+#endif
+}
+
+// outside the initial user namespace, the kernel ignores the subscription
+// to the proc connector, and the table has to poll /proc
+bool test_live_table_outside_initial_namespace()
+{
+#if PS_HAVE_LIVE_TABLE && HAVE_FORK && HAVE_UNSHARE && HAVE_SCHED_H && defined( CLONE_NEWUSER )
+    const pid_t child = fork();
+    if ( child == 0 )
+    {
+        // the kernel may forbid unprivileged user namespaces: nothing to check then
+        if ( unshare( CLONE_NEWUSER ) != 0 )
+            _exit( 0 );
+
+        const ps::live_table table( std::chrono::milliseconds( 100 ) );
+        _exit( table.is_event_driven() ? 1 : 0 );
+    }
+
+    int status = 0;
+    return child > 0 && waitpid( child, &status, 0 ) == child &&
+           WIFEXITED( status ) && WEXITSTATUS( status ) == 0;
+#else
+    return true;
+#endif
+}
+
+#if HAVE_EXECVE && HAVE_FORK
+static pid_t spawn_sleep( const char * seconds )
+{
+    const pid_t pid = fork();
+    if ( pid == 0 )
+    {
+        char * const argv[] = { ( char * )"/usr/bin/sleep", ( char * )seconds, NULL };
+        execve( "/usr/bin/sleep", argv, nullptr );
+        _exit( 1 );
+    }
+    return pid;
+}
+#endif
+
+bool test_pidfd_kill()
+{
+#if PS_HAVE_PIDFD && HAVE_EXECVE && HAVE_FORK
+    const pid_t pid = spawn_sleep( "5" );
+
+    ps::process child( pid );
+    if ( !child.open_pidfd() || child.pidfd() < 0 )
+        return false;
+
+    // copies share the pidfd
+    const ps::process copy( child );
+    if ( copy.pidfd() != child.pidfd() )
+        return false;
+
+    if ( child.wait_exit( std::chrono::milliseconds( 0 ) ) )
+        return false;
+
+    if ( child.kill( false ) != 0 )
+        return false;
+
+    if ( !child.wait_exit( std::chrono::milliseconds( 2000 ) ) )
+        return false;
+
+    // once reaped, the pidfd tells the process is gone instead of signaling another one
+    waitpid( pid, nullptr, 0 );
+    if ( child.kill( false ) != -2 )
+        return false;
+
+    // without a start time, the process is identified by the one read when pinning
+    const pid_t unknown_pid = spawn_sleep( "5" );
+    ps::process unknown( unknown_pid, ps::FIELD_PID );
+    const bool pinned = unknown.start_time() == 0 && unknown.open_pidfd() &&
+                        unknown.start_time() == ps::process( unknown_pid, ps::FIELD_STAT ).start_time();
+
+    // a start time which does not match the process holding the pid is refused
+    ps::process other( unknown_pid, "", "", "", "", unknown.start_time() + 1 );
+    const bool refused = !other.open_pidfd();
+
+    unknown.kill( false );
+    waitpid( unknown_pid, nullptr, 0 );
+    return pinned && refused;
+#else
+    return true;
+#endif
+}
+
+bool test_wait_exit_of_zombie()
+{
+#if PS_HAVE_PROCFS && HAVE_EXECVE && HAVE_FORK && HAVE_CHRONO
+    const pid_t pid = spawn_sleep( "5" );
+
+    // without a pidfd, the process is polled
+    const ps::process child( pid, ps::FIELD_PID );
+    if ( child.pidfd() >= 0 || child.wait_exit( std::chrono::milliseconds( 0 ) ) )
+        return false;
+
+    // not reaped yet, the child still answers kill( pid, 0 )
+    kill( pid, SIGKILL );
+    const bool exited = child.wait_exit( std::chrono::milliseconds( 2000 ) );
+
+    waitpid( pid, nullptr, 0 );
+    return exited;
+#else
+    return true;
+#endif
+}
+
+bool test_exit_watcher()
+{
+#if PS_HAVE_EXIT_WATCHER && HAVE_EXECVE && HAVE_FORK
+    ps::exit_watcher watcher;
+
+    const pid_t short_lived = spawn_sleep( "0.2" );
+    const pid_t long_lived = spawn_sleep( "5" );
+
+    if ( !watcher.watch( ps::process( short_lived ) ) ||
+         !watcher.watch( ps::process( long_lived ) ) ||
+         watcher.size() != 2 )
+        return false;
+
+    const std::vector< pid_t > first = watcher.wait_exit( std::chrono::milliseconds( 2000 ) );
+    const std::vector< pid_t > none = watcher.wait_exit( std::chrono::milliseconds( 0 ) );
+
+    kill( long_lived, SIGKILL );
+    const std::vector< pid_t > second = watcher.wait_exit( std::chrono::milliseconds( 2000 ) );
+
+    waitpid( short_lived, nullptr, 0 );
+    waitpid( long_lived, nullptr, 0 );
+
+    return first == std::vector< pid_t >( 1, short_lived )
+        && none.empty()
+        && second == std::vector< pid_t >( 1, long_lived )
+        && watcher.size() == 0;
+#else
+    return true;
+#endif
+}
+
+bool test_capture_has_unique_pids()
+{
+    const ps::snapshot all_processes = ps::capture();
+    if ( all_processes.empty() )
+        return false;
+
+    for ( std::size_t i = 1; i < all_processes.size(); ++i )
+    {
+        if ( all_processes[i - 1].pid() >= all_processes[i].pid() )
+            return false;
+    }
+
+    return true;
+}
+
+bool test_process_merge()
+{
+    ps::process from_procfs( 42, "/usr/bin/skype", "", "skype" );
+    from_procfs.merge( ps::process( 42, "/opt/skype", "Skype - Contacts", "other", "8.0" ) );
+
+    return from_procfs.cmdline() == "/usr/bin/skype"
+        && from_procfs.title()   == "Skype - Contacts"
+        && from_procfs.name()    == "skype"
+        && from_procfs.version() == "8.0";
+}
+
+bool test_capture_fields()
+{
+    const pid_t self = getpid();
+    const auto find_self = []( const ps::snapshot & processes )
+    {
+        return std::find_if( processes.begin(), processes.end(),
+                             [&]( const ps::process & p ) { return p.pid() == getpid(); } );
+    };
+
+    const ps::snapshot pids_only = ps::capture( ps::ENUMERATE_BSD_APPS, ps::FIELD_PID );
+    const auto me = find_self( pids_only );
+    if ( me == pids_only.end() || !me->cmdline().empty() || !me->name().empty() )
+        return false;
+
+    const ps::snapshot with_names =
+        ps::capture( ps::ENUMERATE_BSD_APPS, ps::FIELD_NAME | ps::FIELD_STAT );
+    const auto named = find_self( with_names );
+    if ( named == with_names.end() || named->name().empty() ||
+         !named->cmdline().empty() || named->start_time() == 0 )
+        return false;
+
+    const ps::process stat_only( self, ps::FIELD_STAT );
+    return stat_only.cmdline().empty()
+        && stat_only.name().empty()
+        && stat_only.start_time() == named->start_time();
+}
+
+bool test_snapshot_table()
+{
+    const ps::fields wanted = ps::FIELD_CMDLINE | ps::FIELD_NAME | ps::FIELD_STAT;
+    const ps::snapshot processes = ps::capture( ps::ENUMERATE_BSD_APPS, wanted );
+    const ps::snapshot_table table( processes );
+    if ( table.size() != processes.size() )
+        return false;
+
+    const std::size_t self = table.find_pid( getpid() );
+    if ( self == ps::snapshot_table::npos || table.find_pid( ps::INVALID_PID ) != ps::snapshot_table::npos )
+        return false;
+
+    const ps::process & me = processes[self];
+    const std::vector< std::size_t > same_name = table.find( ps::COLUMN_NAME, me.name() );
+    if ( std::find( same_name.begin(), same_name.end(), self ) == same_name.end() )
+        return false;
+
+    // every row reads back the process it was built from
+    const ps::snapshot copy = table.to_snapshot();
+    for ( std::size_t i = 0; i < processes.size(); ++i )
+    {
+        if ( copy[i].pid()        != processes[i].pid()     ||
+             copy[i].cmdline()    != processes[i].cmdline() ||
+             copy[i].name()       != processes[i].name()    ||
+             copy[i].start_time() != processes[i].start_time() ||
+             table[i].cmdline()   != processes[i].cmdline() )
+            return false;
+    }
+
+    if ( std::distance( table.begin(), table.end() ) != static_cast< std::ptrdiff_t >( table.size() ) )
+        return false;
+
+    // a table captured straight from /proc holds what the snapshot holds
+    const ps::snapshot_table captured = ps::capture_table( ps::ENUMERATE_BSD_APPS, wanted );
+    const std::size_t captured_self = captured.find_pid( getpid() );
+    return captured_self != ps::snapshot_table::npos
+        && captured[captured_self].cmdline() == me.cmdline()
+        && captured[captured_self].name() == me.name()
+        && captured[captured_self].start_time() == me.start_time()
+        && !me.name().empty();
+}
+
+bool test_string_pool()
+{
+    ps::string_pool pool;
+    const ps::details::shared_string first = pool.intern( boost::string_ref( "/usr/bin/worker" ) );
+    const ps::details::shared_string second = pool.intern( ps::details::shared_string( "/usr/bin/worker" ) );
+    const bool distinct = !pool.intern( boost::string_ref( "/usr/bin/other" ) ).same_storage( first );
+
+    if ( !first.same_storage( second ) || !distinct ||
+         first.str() != "/usr/bin/worker" || pool.size() != 2 )
+        return false;
+
+    // empty strings are never stored, and all share the same storage
+    const ps::details::shared_string empty = pool.intern( boost::string_ref() );
+    if ( !empty.empty() || pool.size() != 2 ||
+         !empty.same_storage( ps::details::shared_string( "" ) ) || empty.same_storage( first ) )
+        return false;
+
+    ps::process worker( 1, "/usr/bin/worker", "", "worker" );
+    worker.intern( pool );
+    if ( pool.size() != 3 || worker.cmdline() != "/usr/bin/worker" )
+        return false;
+
+    // only the strings still used by a process survive a purge
+    return pool.purge() == 1 && pool.size() == 2;
+}
+
+bool test_capture_with_string_pool()
+{
+    ps::string_pool pool;
+    const ps::snapshot first = ps::capture( ps::ENUMERATE_BSD_APPS, ps::FIELD_ALL, pool );
+    const std::size_t strings = pool.size();
+
+    // running processes do not bring new strings on the next capture
+    const unsigned long before = allocations;
+    const ps::snapshot second = ps::capture( ps::ENUMERATE_BSD_APPS, ps::FIELD_ALL, pool );
+    const unsigned long during = allocations - before;
+
+    // the strings are interned as they are read: a process whose strings are
+    // already in the pool only allocates its attributes and its counters
+    return !first.empty()
+        && !second.empty()
+        && strings != 0
+        && pool.size() <= strings + 16
+#if PS_HAVE_PROCFS
+        && during <= 2 * second.size() + 16
+#endif
+        && during != 0;
+}
+
+bool test_process_copies_share_strings()
+{
+    const ps::process original( 42, "/usr/bin/skype", "", "skype" );
+    ps::process copy( original );
+    if ( &copy.cmdline() != &original.cmdline() )
+        return false;
+
+    // completing a copy leaves the original untouched
+    copy.merge( ps::process( 42, "", "Skype - Contacts" ) );
+    if ( copy.title() != "Skype - Contacts" || !original.title().empty() ||
+         copy.cmdline() != original.cmdline() )
+        return false;
+
+    // so do the counters, which are shared the same way
+    ps::process counted( 42, "/usr/bin/skype", "", "skype", "", 1234 );
+    ps::process counted_copy( counted );
+    if ( &counted_copy.stat() != &counted.stat() )
+        return false;
+
+    ps::process_memory memory;
+    memory.size = 4096;
+    counted_copy.set_memory( memory );
+    return counted_copy.memory().size == 4096
+        && counted.memory().size == 0
+        && counted_copy.start_time() == 1234
+        && counted_copy.stat().start_time == 1234;
+}
+
+#if PS_HAVE_PMR
+// takes from the heap what an arena could not hold, and counts it
+struct counting_resource : std::pmr::memory_resource
+{
+    counting_resource()
+        : allocated( 0 )
+    {
+    }
+
+    std::size_t allocated;
+
+private:
+    void * do_allocate( const std::size_t bytes, const std::size_t alignment ) override
+    {
+        ++allocated;
+        return std::pmr::new_delete_resource()->allocate( bytes, alignment );
+    }
+
+    void do_deallocate( void * const memory, const std::size_t bytes, const std::size_t alignment ) override
+    {
+        std::pmr::new_delete_resource()->deallocate( memory, bytes, alignment );
+    }
+
+    bool do_is_equal( const std::pmr::memory_resource & other ) const noexcept override
+    {
+        return this == &other;
+    }
+};
+#endif
+
+bool test_pmr_capture()
+{
+#if PS_HAVE_PMR
+    // the thread buffers of procfs are allocated once, by the first capture
+    ps::capture( ps::ENUMERATE_BSD_APPS, ps::FIELD_ALL, std::pmr::new_delete_resource() );
+
+    // room for a row, its command line and the growth of the columns of every
+    // process. A bigger capture spills over to upstream, which fails the test
+    const std::size_t processes = ps::get_pids_from_procfs().size();
+    std::vector< char > buffer( 1024 * 1024 + 1024 * processes );
+    counting_resource upstream;
+    std::pmr::monotonic_buffer_resource arena( buffer.data(), buffer.size(), &upstream );
+
+    const unsigned long before = allocations;
+    const ps::pmr::snapshot_table table =
+        ps::capture( ps::ENUMERATE_BSD_APPS, ps::FIELD_ALL, &arena );
+    const unsigned long during = allocations - before;
+
+    const std::size_t self = table.find_pid( getpid() );
+    return during == 0
+        && upstream.allocated == 0
+        && self != ps::pmr::snapshot_table::npos
+        && table[self].cmdline() == ps::get_cmdline_from_pid( getpid() )
+        && table[self].start_time() == ps::process( getpid(), ps::FIELD_STAT ).start_time()
+        && table.get_allocator().resource() == &arena;
+#else
+    return true;
+#endif
+}
+
+bool test_mapped_snapshot()
+{
+#if PS_HAVE_MAPPED_SNAPSHOT
+    const std::string path = "test_snapshot.pssnap";
+    const ps::snapshot processes = ps::capture( ps::ENUMERATE_BSD_APPS );
+    if ( !ps::save( processes, path ) )
+        return false;
+
+    const unsigned long before = allocations;
+    ps::mapped_snapshot mapped;
+    const bool opened = mapped.open( path );
+    const std::size_t self = mapped.find_pid( getpid() );
+    const unsigned long during = allocations - before;
+
+    if ( !opened || during != 0 || mapped.size() != processes.size() ||
+         self == ps::mapped_snapshot::npos || mapped.find_pid( ps::INVALID_PID ) != ps::mapped_snapshot::npos )
+        return false;
+
+    for ( std::size_t i = 0; i < processes.size(); ++i )
+    {
+        const ps::process p = mapped.to_process( i );
+        if ( p.pid()        != processes[i].pid()     ||
+             p.cmdline()    != processes[i].cmdline() ||
+             p.name()       != processes[i].name()    ||
+             p.start_time() != processes[i].start_time() )
+            return false;
+    }
+
+    // a truncated file is refused
+    mapped.close();
+    if ( truncate( path.c_str(), sizeof( ps::snapshot_file_header ) + 4 ) != 0 )
+        return false;
+
+    const bool refused = !mapped.open( path ) && !mapped.is_open();
+    remove( path.c_str() );
+    return refused;
+#else
+    return true;
+#endif
+}
+
+bool test_history()
+{
+#if PS_HAVE_HISTORY
+    typedef ps::history::clock clock;
+    const clock::time_point start = clock::now();
+
+    // every tick, one process exits, one starts, and one changes its title
+    std::vector< ps::snapshot > pushed;
+    ps::snapshot current;
+    for ( pid_t pid = 1; pid <= 100; ++pid )
+        current.push_back( ps::process( pid, "/usr/bin/worker --id", "", "worker", "", pid ) );
+
+    ps::history recorded( 50, 8 );
+    for ( int tick = 0; tick < 120; ++tick )
+    {
+        current.erase( current.begin() );
+        current.push_back( ps::process( 101 + tick, "/usr/bin/worker --id", "", "worker", "", tick ) );
+        current[tick % current.size()] = ps::process( current[tick % current.size()].pid(),
+                                                      "/usr/bin/worker --id", "busy", "worker", "",
+                                                      current[tick % current.size()].start_time() );
+
+        // processes are pushed in any order
+        ps::snapshot shuffled( current.rbegin(), current.rend() );
+        recorded.push( shuffled, start + std::chrono::seconds( tick ) );
+        pushed.push_back( current );
+    }
+
+    if ( recorded.size() < 50 || recorded.size() > 50 + 8 )
+        return false;
+
+    const std::size_t oldest = pushed.size() - recorded.size();
+    for ( std::size_t tick = 0; tick < recorded.size(); ++tick )
+    {
+        const ps::snapshot restored = recorded.at( tick );
+        const ps::snapshot & expected = pushed[oldest + tick];
+        if ( restored.size() != expected.size() ||
+             recorded.time( tick ) != start + std::chrono::seconds( oldest + tick ) )
+            return false;
+
+        for ( std::size_t i = 0; i < expected.size(); ++i )
+        {
+            if ( restored[i].pid()        != expected[i].pid()     ||
+                 restored[i].cmdline()    != expected[i].cmdline() ||
+                 restored[i].title()      != expected[i].title()   ||
+                 restored[i].start_time() != expected[i].start_time() )
+                return false;
+        }
+    }
+
+    // seeking by time gives the last tick at or before the time asked for
+    ps::snapshot at_time;
+    if ( recorded.find( start ) != ps::history::npos ||
+         recorded.at_time( start, at_time ) ||
+         recorded.find( start + std::chrono::milliseconds( 119500 ) ) != recorded.size() - 1 ||
+         !recorded.at_time( start + std::chrono::milliseconds( ( oldest + 10 ) * 1000 + 500 ), at_time ) ||
+         at_time.size() != pushed[oldest + 10].size() ||
+         at_time.front().pid() != pushed[oldest + 10].front().pid() )
+        return false;
+
+    return recorded.memory_usage() > 0;
+#else
+    return true;
+#endif
+}
+
+bool test_snapshot_index()
+{
+    // linux separates the arguments of a command line with null characters
+    const std::string first_worker( "/usr/bin/worker\0--id=1", 22 );
+    const std::string second_worker( "/usr/bin/worker\0--id=2", 22 );
+
+    ps::snapshot processes;
+    processes.emplace_back( 10, first_worker, "", "worker", "", 1 );
+    processes.emplace_back( 12, second_worker, "", "worker", "", 2 );
+    processes.emplace_back( 11, "/bin/sh", "", "sh", "", 3 );
+    processes.emplace_back( 13, "", "", "", "", 4 );
+    processes.emplace_back( 10, "/bin/duplicate", "", "", "", 5 );
+
+    const ps::snapshot_index index( processes );
+    const ps::process * const sh = index.find_pid( 11 );
+    const ps::process * const first = index.find_pid( 10 );
+    if ( !sh || sh->name() != "sh" || !first || first->start_time() != 1 ||
+         index.find_pid( 14 ) || index.find_pid( ps::INVALID_PID ) )
+        return false;
+
+    const ps::snapshot_index::range workers = index.find_executable( "/usr/bin/worker" );
+    const ps::snapshot_index::range named = index.find_name( "worker" );
+    if ( workers.size() != 2 || named.size() != 2 ||
+         workers.begin()->pid() != 10 || ( ++workers.begin() ).index() != 1 ||
+         index.find_cmdline( second_worker ).size() != 1 ||
+         index.find_cmdline( "/usr/bin/worker" ).size() != 0 ||
+         index.find_name( "" ).size() != 0 || index.find_name( "init" ).size() != 0 )
+        return false;
+
+    // every running process is found by pid
+    const ps::snapshot running = ps::capture( ps::ENUMERATE_BSD_APPS );
+    const ps::snapshot_index running_index( running );
+    for ( const ps::process & p : running )
+    {
+        if ( running_index.find_pid( p.pid() ) != &p )
+            return false;
+    }
+
+    return running_index.find_pid( getpid() ) != nullptr;
+}
+
+bool test_get_running_process_ids_with_limit()
+{
+#if PS_HAVE_PROCFS || HAVE_LIBPROC_H || HAVE_ENUMPROCESSES
+    // the previous interface, which returns at most max_pids pids
+    std::vector< pid_t > all;
+    const std::vector< pid_t > few = ps::get_running_process_ids( 2 );
+    const std::vector< pid_t > some = ps::get_running_process_ids();
+    return ps::get_running_process_ids( all ) && all.size() >= 2 && few.size() == 2 &&
+           !some.empty() && some.size() <= 500;
+#else
+    return true;
+#endif
+}
+
+bool test_capture_thousands_of_processes()
+{
+#if HAVE_FORK && HAVE_KILL
+    // more processes than the 500 enumeration used to stop at
+    const std::size_t wanted = 3000;
+    std::vector< pid_t > children;
+    children.reserve( wanted );
+    for ( std::size_t i = 0; i < wanted; ++i )
+    {
+        const pid_t pid = fork();
+        if ( pid == 0 )
+        {
+            pause();
+            _exit( 0 );
+        }
+
+        // RLIMIT_NPROC, or a small pid_max, may allow fewer processes
+        if ( pid < 0 )
+            break;
+
+        children.push_back( pid );
+    }
+
+    const ps::snapshot processes = ps::capture( ps::ENUMERATE_BSD_APPS, ps::FIELD_PID );
+    std::vector< pid_t > listed;
+    const bool complete = ps::get_running_process_ids( listed );
+    std::sort( listed.begin(), listed.end() );
+
+    // too few children would not go past the 500 pids of the old enumeration
+    bool all_seen = complete && children.size() >= 600;
+    for ( const pid_t pid : children )
+    {
+        all_seen = all_seen &&
+                   std::binary_search( listed.begin(), listed.end(), pid ) &&
+                   std::binary_search( processes.begin(), processes.end(), ps::process( pid, "" ),
+                                       []( const ps::process & left, const ps::process & right )
+        {
+            return left.pid() < right.pid();
+        } );
+    }
+
+    for ( const pid_t pid : children )
+        kill( pid, SIGKILL );
+
+    for ( const pid_t pid : children )
+        waitpid( pid, nullptr, 0 );
+
+    return all_seen;
+#else
+    return true;
+#endif
+}
+
+// a fake OS listing count pids, and counting the calls it takes
+struct fake_lister
+{
+    fake_lister( const std::size_t count, const bool fails = false )
+        : count( count )
+        , fails( fails )
+        , calls( 0 )
+    {
+    }
+
+    bool operator()( pid_t * const buffer, const std::size_t capacity, std::size_t & found )
+    {
+        ++calls;
+        found = std::min( count, capacity );
+        for ( std::size_t i = 0; i < found; ++i )
+            buffer[i] = static_cast< pid_t >( i + 1 );
+
+        return !fails;
+    }
+
+    std::size_t count;
+    bool        fails;
+    unsigned    calls;
+};
+
+bool test_list_pids()
+{
+    std::vector< pid_t > pids;
+
+    // fits at once
+    fake_lister few( 100 );
+    if ( !ps::details::list_pids( pids, 1024, 4096, std::ref( few ) ) || pids.size() != 100 ||
+         few.calls != 1 || pids.back() != 100 )
+        return false;
+
+    // the buffer doubles until the list fits: 1024, 2048, 4096
+    fake_lister many( 3000 );
+    if ( !ps::details::list_pids( pids, 1024, 1 << 22, std::ref( many ) ) || pids.size() != 3000 ||
+         many.calls != 3 )
+        return false;
+
+    // a list filling the buffer exactly is read again with more room
+    fake_lister exact( 1024 );
+    if ( !ps::details::list_pids( pids, 1024, 4096, std::ref( exact ) ) || pids.size() != 1024 ||
+         exact.calls != 2 )
+        return false;
+
+    // found == capacity == limit: the list may have been cut short, and cannot grow
+    fake_lister at_limit( 4096 );
+    if ( ps::details::list_pids( pids, 1024, 4096, std::ref( at_limit ) ) || pids.size() != 4096 ||
+         at_limit.calls != 3 )
+        return false;
+
+    fake_lister beyond_limit( 10000 );
+    if ( ps::details::list_pids( pids, 1024, 4096, std::ref( beyond_limit ) ) || pids.size() != 4096 )
+        return false;
+
+    // an error clears the list
+    fake_lister failing( 10, true );
+    return !ps::details::list_pids( pids, 1024, 4096, std::ref( failing ) ) && pids.empty();
+}
+
+bool test_pid_set()
+{
+    ps::pid_set left( 1000 );
+    ps::pid_set right( 1000 );
+    for ( pid_t pid = 0; pid < 1000; pid += 2 )
+        left.insert( pid );
+    for ( pid_t pid = 0; pid < 1000; pid += 3 )
+        right.insert( pid );
+
+    if ( left.count() != 500 || right.count() != 334 ||
+         !left.contains( 998 ) || left.contains( 999 ) || left.contains( -1 ) ||
+         left.insert( 2 ) || !left.erase( 2 ) || left.erase( 2 ) || !left.insert( 2 ) )
+        return false;
+
+    // multiples of 6 are in both, the other even numbers only on the left
+    const ps::pid_set both = left & right;
+    const ps::pid_set either = left | right;
+    const ps::pid_set only_left = left - right;
+    if ( both.count() != 167 || either.count() != 667 || only_left.count() != 333 ||
+         ( only_left | both ) != left || !( only_left & right ).empty() )
+        return false;
+
+    const std::vector< pid_t > pids = both.to_vector();
+    for ( std::size_t i = 0; i < pids.size(); ++i )
+    {
+        if ( pids[i] != static_cast< pid_t >( i * 6 ) )
+            return false;
+    }
+
+    // pids above the capacity grow the set
+    ps::pid_set grown( 64 );
+    if ( !grown.insert( 100000 ) || !grown.contains( 100000 ) || grown.capacity() <= 100000 ||
+         ( grown & left ).count() != 0 || ( left | grown ).count() != 501 )
+        return false;
+
+    // a set built from a snapshot selects the same processes back
+    const ps::snapshot processes = ps::capture( ps::ENUMERATE_BSD_APPS );
+    const ps::pid_set running( processes );
+    const ps::snapshot selected = running.select( processes );
+    const ps::snapshot reread = running.to_snapshot();
+    return running.count() == processes.size() && selected.size() == processes.size() &&
+           running.contains( getpid() ) && !reread.empty() && reread.size() <= processes.size();
+}
+
+bool test_capture_into()
+{
+    const auto by_pid = []( const ps::process & left, const ps::process & right )
+    {
+        return left.pid() < right.pid();
+    };
+
+    ps::snapshot processes;
+    ps::capture_into( processes, ps::ENUMERATE_BSD_APPS );
+    if ( processes.empty() || !std::is_sorted( processes.begin(), processes.end(), by_pid ) )
+        return false;
+
+    // a stale and unsorted snapshot is brought up to date
+    ps::snapshot stale( processes.rbegin(), processes.rend() );
+    stale.emplace_back( ps::INVALID_PID - 1, "/no/such/process" );
+    const pid_t changed = stale[0].pid();
+    stale[0].reset( changed, "changed", "changed", 1 );
+    ps::capture_into( stale, ps::ENUMERATE_BSD_APPS );
+
+    const auto refreshed = std::find_if( stale.begin(), stale.end(), [&]( const ps::process & p )
+    {
+        return p.pid() == changed;
+    } );
+    if ( !std::is_sorted( stale.begin(), stale.end(), by_pid ) || !stale.front().valid() ||
+         ( refreshed != stale.end() && refreshed->start_time() == 1 ) )
+        return false;
+
+    // once the set of processes is stable, polling does not allocate. A busy
+    // host may start or exec processes during a capture, which allocates, so
+    // only the captures which saw the same processes as the previous one count
+    std::vector< std::pair< pid_t, std::string > > before_capture;
+    before_capture.reserve( processes.size() * 2 );
+    for ( unsigned attempt = 0; attempt < 50; ++attempt )
+    {
+        before_capture.clear();
+        for ( const ps::process & p : processes )
+            before_capture.emplace_back( p.pid(), p.cmdline() );
+
+        const unsigned long before = allocations;
+        ps::capture_into( processes, ps::ENUMERATE_BSD_APPS );
+        const unsigned long during = allocations - before;
+
+        bool stable = before_capture.size() == processes.size();
+        for ( std::size_t i = 0; stable && i < processes.size(); ++i )
+            stable = before_capture[i].first == processes[i].pid() &&
+                     before_capture[i].second == processes[i].cmdline();
+
+        if ( stable )
+            return during == 0;
+
+        std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+    }
+
+    // the processes never settled
+    return false;
+}
+
+bool test_cpu_sampler()
+{
+#if PS_HAVE_CPU_SAMPLER && HAVE_FORK && HAVE_KILL
+    ps::cpu_sampler sampler;
+    const std::vector< ps::cpu_usage > & first = sampler.tick();
+    if ( first.empty() || first.front().total != 0 || sampler.system_usage().total != 0 )
+        return false;
+
+    // a child which keeps one CPU busy
+    const pid_t busy = fork();
+    if ( busy == 0 )
+    {
+        for ( volatile unsigned long i = 0; ; ++i )
+            ;
+    }
+
+    // the child started since the first tick, so it is charged with all its time
+    std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+    const std::vector< ps::cpu_usage > & second = sampler.tick();
+    const bool started_charged = std::find_if( second.begin(), second.end(), [&]( const ps::cpu_usage & u )
+    {
+        return u.pid == busy && u.total > 0;
+    } ) != second.end();
+    std::this_thread::sleep_for( std::chrono::milliseconds( 300 ) );
+
+    const unsigned long before = allocations;
+    const std::vector< ps::cpu_usage > & usage = sampler.tick();
+    const unsigned long during = allocations - before;
+
+    kill( busy, SIGKILL );
+    waitpid( busy, nullptr, 0 );
+
+    const auto child = std::find_if( usage.begin(), usage.end(), [&]( const ps::cpu_usage & u )
+    {
+        return u.pid == busy;
+    } );
+
+    const ps::system_cpu_usage & system = sampler.system_usage();
+    return started_charged && child != usage.end() && child->total > 50 && child->user > child->system &&
+           system.total > 0 && system.total <= 100 && system.cpus >= 1 && during == 0;
+#else
+    return true;
+#endif
+}
+
+bool test_memory_accounting()
+{
+    const std::string smaps =
+        "00400000-00452000 r-xp 00000000 08:02 173521      /usr/bin/dbus-daemon\n"
+        "Size:                328 kB\nRss:                  300 kB\nPss:                  100 kB\n"
+        "Private_Clean:         20 kB\nPrivate_Dirty:         10 kB\nSwap:                   8 kB\n"
+        "SwapPss:                4 kB\n"
+        "7ffd09000000-7ffd09023000 rw-p 00000000 00:00 0                          [stack]\n"
+        "Rss:                   12 kB\nPss:                   12 kB\nPrivate_Dirty:         12 kB\n"
+        "Pss_Dirty:             12 kB\nSwapPss:                2 kB";
+
+    // fed whole, then a few bytes at a time so that lines are split between reads
+    ps::proportional_memory whole;
+    ps::details::smaps_parser whole_parser( whole );
+    whole_parser.feed( smaps.data(), smaps.size() );
+    whole_parser.finish();
+
+    ps::proportional_memory split;
+    ps::details::smaps_parser split_parser( split );
+    for ( std::size_t i = 0; i < smaps.size(); i += 7 )
+        split_parser.feed( smaps.data() + i, std::min< std::size_t >( 7, smaps.size() - i ) );
+    split_parser.finish();
+
+    for ( const ps::proportional_memory & memory : { whole, split } )
+    {
+        if ( memory.rss != 312 * 1024 || memory.pss != 112 * 1024 || memory.uss != 42 * 1024 ||
+             memory.swap != 8 * 1024 || memory.swap_pss != 6 * 1024 )
+            return false;
+    }
+
+#if PS_HAVE_PROCFS && HAVE_FORK
+    // a child which exited is counted as unreadable
+    const pid_t child = fork();
+    if ( child == 0 )
+        _exit( 0 );
+
+    waitpid( child, nullptr, 0 );
+
+    const std::vector< pid_t > pids = { getpid(), child };
+    const ps::memory_accounting rollup = ps::account_memory( pids, ps::parallel_options( 2 ) );
+    const ps::memory_accounting full = ps::account_memory( pids, ps::parallel_options( 2 ), ps::SMAPS_FULL );
+
+    for ( const ps::memory_accounting * accounting : { &rollup, &full } )
+    {
+        if ( accounting->processes.size() != 1 || accounting->unreadable != 1 ||
+             accounting->processes.front().pid != getpid() ||
+             accounting->total.pss != accounting->processes.front().pss ||
+             accounting->total.pss == 0 || accounting->total.uss == 0 ||
+             accounting->total.uss > accounting->total.pss || accounting->total.pss > accounting->total.rss )
+            return false;
+    }
+
+    return full.rollups == 0 && rollup.rollups <= 1;
+#else
+    return true;
+#endif
+}
+
+bool test_match_samples()
+{
+    typedef ps::details::process_sample< unsigned long long > sample;
+
+    // pid 3 was reused since the previous tick, at uptime 100 or later
+    const sample previous_samples[] = { { 1, 10, 50 }, { 3, 30, 70 }, { 4, 40, 90 } };
+    const sample current_samples[] = { { 1, 10, 60 }, { 2, 20, 5 }, { 3, 120, 8 }, { 4, 40, 85 } };
+    const std::vector< sample > previous( previous_samples, previous_samples + 3 );
+    const std::vector< sample > current( current_samples, current_samples + 4 );
+
+    std::vector< unsigned long long > deltas;
+    ps::details::match_samples( current, previous, 100,
+                                [&]( const sample & s, const unsigned long long baseline )
+    {
+        deltas.push_back( ps::details::counter_delta( s.counters, baseline ) );
+    } );
+
+    // pid 2 started before the previous tick, which missed it; pid 4 went backwards
+    const unsigned long long expected[] = { 10, 0, 8, 0 };
+    return deltas == std::vector< unsigned long long >( expected, expected + 4 );
+}
+
+bool test_io_sampler()
+{
+#if PS_HAVE_IO_SAMPLER && HAVE_FORK
+    unsigned long long uptime = 0;
+    if ( !ps::details::parse_uptime( "350735.47 234388.90\n", 20, 100, uptime ) || uptime != 35073547 ||
+         !ps::details::parse_uptime( "12.5", 4, 1000, uptime ) || uptime != 12500 ||
+         ps::details::parse_uptime( "", 0, 100, uptime ) )
+        return false;
+
+    // the error is that of the syscall which failed, never a stale errno
+    ps::process_io io;
+    int error = -1;
+    errno = EACCES;
+    if ( !ps::details::read_process_io( getpid(), io, &error ) || error != 0 ||
+         ps::details::read_process_io( ps::INVALID_PID, io, &error ) || error != ESRCH )
+        return false;
+
+    ps::io_sampler sampler;
+    const std::vector< ps::io_rate > & first = sampler.tick();
+    if ( first.empty() || first.front().rchar != 0 )
+        return false;
+
+    // a child which keeps writing to /dev/null
+    const pid_t writer = fork();
+    if ( writer == 0 )
+    {
+        static char buffer[65536];
+        const int fd = open( "/dev/null", O_WRONLY );
+        for ( ;; )
+        {
+            if ( write( fd, buffer, sizeof( buffer ) ) < 0 )
+                _exit( 1 );
+        }
+    }
+
+    std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+    sampler.tick();
+    std::this_thread::sleep_for( std::chrono::milliseconds( 200 ) );
+
+    const unsigned long before = allocations;
+    const std::vector< ps::io_rate > & rates = sampler.tick();
+    const unsigned long during = allocations - before;
+
+    const std::vector< ps::io_rate > top = sampler.top( 3 );
+    ps::process( writer ).kill( false );
+    waitpid( writer, nullptr, 0 );
+
+    const auto child = std::find_if( rates.begin(), rates.end(), [&]( const ps::io_rate & rate )
+    {
+        return rate.pid == writer;
+    } );
+
+    // processes we may not inspect are left out rather than failing the tick
+    const bool ranked = top.size() == std::min< std::size_t >( 3, rates.size() ) &&
+                        std::is_sorted( top.begin(), top.end(), []( const ps::io_rate & left, const ps::io_rate & right )
+    {
+        return left.total() > right.total();
+    } );
+
+    return child != rates.end() && child->wchar > 1024 * 1024 && child->syscw > 10 &&
+           ranked && during == 0 && sampler.ticks() == 3;
+#else
+    return true;
+#endif
+}
+
 bool test_extract_name_and_icon_from_argv()
 {
     const auto & name_and_icon =
@@ -390,9 +1855,51 @@ int main( int, char * argv[] )
     LAUNCH_TEST( test_version );
     LAUNCH_TEST( test_title );
     LAUNCH_TEST( test_icon );
+    LAUNCH_TEST( test_invalid_process_with_title );
     LAUNCH_TEST( test_foreground_process );
     LAUNCH_TEST( test_foreground_process_has_icon );
     LAUNCH_TEST( test_get_argv_from_pid );
+    LAUNCH_TEST( test_get_cmdline_from_pid );
+    LAUNCH_TEST( test_get_cmdlines_from_pids );
+    LAUNCH_TEST( test_procfs_directory );
+    LAUNCH_TEST( test_parse_pid );
+    LAUNCH_TEST( test_parallel_capture );
+    LAUNCH_TEST( test_io_uring_capture );
+    LAUNCH_TEST( test_io_uring_reads_long_cmdline );
+    LAUNCH_TEST( test_read_procfs_file_does_not_allocate );
+    LAUNCH_TEST( test_read_procfs_file_truncates );
+    LAUNCH_TEST( test_capture_allocations );
+    LAUNCH_TEST( test_parse_stat_identity );
+    LAUNCH_TEST( test_parse_process_stat );
+    LAUNCH_TEST( test_process_memory );
+    LAUNCH_TEST( test_memory_reader );
+    LAUNCH_TEST( test_process_io );
+    LAUNCH_TEST( test_capture_delta );
+    LAUNCH_TEST( test_live_table );
+    LAUNCH_TEST( test_live_table_outside_initial_namespace );
+    LAUNCH_TEST( test_pidfd_kill );
+    LAUNCH_TEST( test_wait_exit_of_zombie );
+    LAUNCH_TEST( test_exit_watcher );
+    LAUNCH_TEST( test_capture_has_unique_pids );
+    LAUNCH_TEST( test_process_merge );
+    LAUNCH_TEST( test_capture_fields );
+    LAUNCH_TEST( test_snapshot_table );
+    LAUNCH_TEST( test_string_pool );
+    LAUNCH_TEST( test_capture_with_string_pool );
+    LAUNCH_TEST( test_process_copies_share_strings );
+    LAUNCH_TEST( test_pmr_capture );
+    LAUNCH_TEST( test_mapped_snapshot );
+    LAUNCH_TEST( test_history );
+    LAUNCH_TEST( test_snapshot_index );
+    LAUNCH_TEST( test_list_pids );
+    LAUNCH_TEST( test_get_running_process_ids_with_limit );
+    LAUNCH_TEST( test_capture_thousands_of_processes );
+    LAUNCH_TEST( test_pid_set );
+    LAUNCH_TEST( test_capture_into );
+    LAUNCH_TEST( test_cpu_sampler );
+    LAUNCH_TEST( test_memory_accounting );
+    LAUNCH_TEST( test_match_samples );
+    LAUNCH_TEST( test_io_sampler );
     LAUNCH_TEST( test_extract_name_and_icon_from_argv );
     LAUNCH_TEST( test_get_package_id );
     LAUNCH_TEST( test_icns_extraction );